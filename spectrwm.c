@@ -40,9 +40,14 @@
 #else
 #include "tree.h"
 #endif
+#if defined(__linux__)
+#define SWM_INOTIFY
+#include <sys/inotify.h>
+#endif
 
 /* /usr/includes */
 #include <ctype.h>
+#include <dirent.h>
 #include <err.h>
 #include <errno.h>
 #include <poll.h>
@@ -74,6 +79,10 @@
     || defined(__OpenBSD__) || defined(__NetBSD__))
 #define SWM_XCB_HAS_XINPUT
 #endif
+#if !defined(SWM_XCB_HAS_XKB) && (defined(__linux__) || defined(__FreeBSD__)	\
+    || defined(__OpenBSD__) || defined(__NetBSD__))
+#define SWM_XCB_HAS_XKB
+#endif
 #include <xcb/xcb.h>
 #include <xcb/xcb_atom.h>
 #include <xcb/xcb_aux.h>
@@ -83,6 +92,9 @@
 #ifdef SWM_XCB_HAS_XINPUT
 #include <xcb/xinput.h>
 #endif
+#ifdef SWM_XCB_HAS_XKB
+#include <xcb/xkb.h>
+#endif
 #include <xcb/xtest.h>
 #include <xcb/randr.h>
 
@@ -258,6 +270,16 @@ uint32_t		swm_debug = 0
 
 #define EWMH_ALL_DESKTOPS		(0xffffffff)
 
+/* Pending root window property updates, written by ewmh_flush(). */
+#define SWM_EWMH_DIRTY_CLIENT_LIST		(1 << 0)
+#define SWM_EWMH_DIRTY_CLIENT_LIST_STACKING	(1 << 1)
+#define SWM_EWMH_DIRTY_ACTIVE_WINDOW		(1 << 2)
+#define SWM_EWMH_DIRTY_CURRENT_DESKTOP		(1 << 3)
+#define SWM_EWMH_DIRTY_DESKTOP_NAMES		(1 << 4)
+#define SWM_EWMH_DIRTY_NUMBER_OF_DESKTOPS	(1 << 5)
+#define SWM_EWMH_DIRTY_DESKTOP_VIEWPORT	(1 << 6)
+#define SWM_EWMH_DIRTY_WORKAREA			(1 << 7)
+
 /* convert 8-bit to 16-bit */
 #define RGB_8_TO_16(col)	(((col) << 8) + (col))
 
@@ -354,6 +376,12 @@ uint32_t		swm_debug = 0
     SWM_COUNT_DESKTOP)
 #define SWM_COUNT_ALL		(SWM_COUNT_NORMAL | SWM_COUNT_ICONIC)
 
+/* Window state accounted in workspace counters. */
+#define SWM_WCOUNT_HIDDEN	(1 << 0)
+#define SWM_WCOUNT_DESKTOP	(1 << 1)
+#define SWM_WCOUNT_CLASSES	(4)
+#define SWM_WCOUNT_URGENT	(1 << 2)
+
 #define SWM_WIN_UNFOCUS		(1 << 0)
 #define SWM_WIN_NOUNMAP		(1 << 1)
 
@@ -381,6 +409,19 @@ uint32_t		swm_debug = 0
 #define SWM_CONF_DELIMLIST	","
 #define SWM_CONF_WHITESPACE	" \t\n"
 
+/* Config subsystems, diffed on reload to apply only what changed. */
+enum {
+	SWM_RELOAD_LAYOUT,
+	SWM_RELOAD_BAR,
+	SWM_RELOAD_COLORS,
+	SWM_RELOAD_STATUS,
+	SWM_RELOAD_SOURCES,
+	SWM_RELOAD_BINDINGS,
+	SWM_RELOAD_QUIRKS,
+	SWM_RELOAD_COUNT
+};
+#define SWM_RELOAD_ALL		((1 << SWM_RELOAD_COUNT) - 1)
+
 #ifndef SWM_LIB
 #define SWM_LIB			"/usr/local/lib/libswmhack.so"
 #endif
@@ -388,6 +429,19 @@ uint32_t		swm_debug = 0
 char			**start_argv;
 char			*conf_file = NULL;
 bool			conf_file_user = false;
+uint32_t		conf_sig[SWM_RELOAD_COUNT];	/* Per subsystem. */
+
+/* Automatic reload when a loaded config file is rewritten. */
+#define SWM_CONF_SETTLE_MS	(250)
+struct conf_watch {
+	SLIST_ENTRY(conf_watch)	entry;
+	int			wd;	/* Watch on the parent directory. */
+	char			*name;	/* File name within directory. */
+};
+SLIST_HEAD(conf_watch_list, conf_watch) conf_watches =
+    SLIST_HEAD_INITIALIZER(conf_watches);
+int			conf_notify_fd = -1;
+struct timespec		conf_settle;	/* Reload deadline; 0 when idle. */
 xcb_atom_t		a_state;
 xcb_atom_t		a_change_state;
 xcb_atom_t		a_prot;
@@ -405,14 +459,46 @@ volatile sig_atomic_t   restart_wm = 0;
 volatile sig_atomic_t   reload_conf = 0;
 xcb_timestamp_t		event_time = 0;
 int			outputs = 0;
+unsigned int		color_gen = 1;	/* Bumped on any color change. */
+bool			bars_dirty = false;	/* Some bar needs rendering. */
 xcb_window_t		pointer_window = XCB_WINDOW_NONE;
+
+/* Root position of the button press that invoked the current action. */
+struct pointer_press {
+	bool			valid;
+	xcb_window_t		root;
+	int16_t			x;
+	int16_t			y;
+} press_pos = { false, XCB_WINDOW_NONE, 0, 0 };
+
+/*
+ * Last queried top-level window under the pointer, used instead of
+ * QueryPointer while valid. Frames, bars and regions select Enter, so the
+ * child can only change after an Enter/Motion event or when windows are
+ * mapped, unmapped, moved or restacked; each of those drops the cache.
+ */
+struct pointer_cache {
+	bool			valid;
+	xcb_window_t		root;
+	xcb_window_t		child;
+	int16_t			x;	/* Somewhere within child. */
+	int16_t			y;
+} pointer_cache = { false, XCB_WINDOW_NONE, XCB_WINDOW_NONE, 0, 0 };
 bool			randr_support = false;
 bool			randr_scan = false;
+bool			randr_monitors = false;	/* RandR 1.5 GetMonitors. */
 int			randr_eventbase;
 unsigned int		numlockmask = 0;
+bool			numlockmask_valid = false;
+int			keysyms_per_keycode = 0;	/* 0 if unknown. */
+uint32_t		keymap_pending = 0;
+#define SWM_KEYMAP_SYMS		(1 << 0)	/* Keysyms changed. */
+#define SWM_KEYMAP_MODS		(1 << 1)	/* Modifier map changed. */
 bool			xinput2_support = false;
 int			xinput2_opcode;
 bool			xinput2_raw = false;
+bool			xkb_support = false;
+int			xkb_eventbase;
 
 Display			*display;
 xcb_connection_t	*conn;
@@ -426,12 +512,20 @@ pid_t			searchpid;
 volatile sig_atomic_t	search_resp;
 int			search_resp_action;
 
+/* Signal handler wakeup for poll(). */
+int			sig_pipe[2] = { -1, -1 };
+
+/* X, bar_action, config watch, search response, signals; sources follow. */
+#define SWM_POLL_FIXED		(5)
+
 struct search_window {
 	TAILQ_ENTRY(search_window)	entry;
 	int				idx;
 	struct ws_win			*win;
+	struct swm_screen		*s;
 	xcb_gcontext_t			gc;
 	xcb_window_t			indicator;
+	XftDraw				*draw;
 };
 TAILQ_HEAD(search_winlist, search_window) search_wl =
     TAILQ_HEAD_INITIALIZER(search_wl);
@@ -505,6 +599,7 @@ bool		warp_focus = false;
 bool		warp_pointer = false;
 bool		workspace_autorotate = false;
 bool		workspace_clamp = false;
+bool		workspace_park = false;
 double		dialog_ratio = 0.6;
 bool		bar_version = false;
 bool		bar_enabled = true;
@@ -518,6 +613,7 @@ char		*bar_fonts = NULL;
 char		*bar_fontname_pua = NULL;
 char		*bar_format = NULL;
 bool		 bar_action_expand = false;
+bool		 bar_action_keyed = false;
 int		 bar_workspace_limit = 0;
 bool		 stack_enabled = true;
 bool		 clock_enabled = true;
@@ -586,6 +682,73 @@ int		font_adjusted = 0;
 xcb_keycode_t	cancel_keycode = XCB_NO_SYMBOL;
 char		bar_ext[SWM_BAR_MAX];
 char		bar_ext_buf[SWM_BAR_MAX];
+size_t		bar_ext_len = 0;
+int		bar_fd = -1;
+
+/* Keyed bar_action output, referenced with +A{key}. */
+#define SWM_BAR_KEY_MAX		(32)
+struct bar_segment {
+	SLIST_ENTRY(bar_segment)	entry;
+	char				key[SWM_BAR_KEY_MAX];
+	char				*value;
+};
+SLIST_HEAD(bar_segment_list, bar_segment) bar_segments =
+    SLIST_HEAD_INITIALIZER(bar_segments);
+
+/* Named status commands, each on its own pipe; also referenced with +A{key}. */
+#define SWM_BAR_SOURCE_BACKOFF_MIN	(1)	/* Seconds. */
+#define SWM_BAR_SOURCE_BACKOFF_MAX	(60)
+#define SWM_BAR_SOURCE_STABLE		(30)	/* Runtime that resets backoff. */
+#define SWM_BAR_SOURCE_CMD		(0)
+#define SWM_BAR_SOURCE_INTERVAL		(1)
+struct bar_source {
+	TAILQ_ENTRY(bar_source)	entry;
+	char			name[SWM_BAR_KEY_MAX];
+	char			*cmd;
+	int			interval;	/* Rerun delay after exit. */
+	bool			configured;
+	pid_t			pid;
+	int			fd;
+	char			buf[SWM_BAR_MAX];
+	size_t			len;
+	char			*value;
+	int			backoff;
+	struct timespec		started;
+	struct timespec		next;		/* Start time when not running. */
+};
+TAILQ_HEAD(bar_source_list, bar_source) bar_sources =
+    TAILQ_HEAD_INITIALIZER(bar_sources);
+int		bar_source_count = 0;
+
+/* In-process status providers, sampled with pread on pre-opened files. */
+#define SWM_BAR_STAT_INTERVAL	(1)	/* Seconds between samples. */
+#define SWM_BAR_STAT_BUFSZ	(4096)	/* Initial read buffer, grows. */
+#define SWM_BAR_STAT_POWER	"/sys/class/power_supply"
+enum {
+	SWM_BAR_STAT_BATTERY,
+	SWM_BAR_STAT_CPU,
+	SWM_BAR_STAT_LOAD,
+	SWM_BAR_STAT_MEM,
+	SWM_BAR_STAT_NET,
+	SWM_BAR_STAT_MAX
+};
+struct bar_stat {
+	const char		*path;
+	int			fd;
+	bool			wanted;
+	bool			failed;
+	unsigned long long	prev[2];	/* Counters for rates. */
+	char			value[32];
+	struct timespec		last;		/* Time of last sample. */
+} bar_stats[SWM_BAR_STAT_MAX] = {
+	{ NULL,			-1, false, false, { 0, 0 }, "", { 0, 0 } },
+	{ "/proc/stat",		-1, false, false, { 0, 0 }, "", { 0, 0 } },
+	{ "/proc/loadavg",	-1, false, false, { 0, 0 }, "", { 0, 0 } },
+	{ "/proc/meminfo",	-1, false, false, { 0, 0 }, "", { 0, 0 } },
+	{ "/proc/net/dev",	-1, false, false, { 0, 0 }, "", { 0, 0 } },
+};
+char		*bar_stat_buf = NULL;	/* Shared by all providers. */
+size_t		bar_stat_bufsz = 0;
 char		bar_vertext[SWM_BAR_MAX];
 bool		bar_extra = false;
 time_t		time_started;
@@ -595,6 +758,17 @@ XFontSetExtents	*bar_fs_extents;
 char		**bar_fontnames = NULL;
 int		num_xftfonts = 0;
 int		font_pua_index = 0;
+
+/* Opened Xft fonts, shared by screens with matching visuals. */
+struct swm_xftfont {
+	TAILQ_ENTRY(swm_xftfont)	entry;
+	char				*name;
+	int				screen;	/* Screen it was opened on. */
+	XftFont				*font;	/* NULL if it failed to load. */
+	int				refs;
+};
+TAILQ_HEAD(swm_xftfont_list, swm_xftfont) xftfonts =
+    TAILQ_HEAD_INITIALIZER(xftfonts);
 bool		bar_font_legacy = true;
 char		*startup_exception = NULL;
 unsigned int	nr_exceptions = 0;
@@ -645,6 +819,20 @@ struct swm_stackable {
 };
 SLIST_HEAD(swm_stack_list, swm_stackable);
 
+/* Bar colors resolved for the current focus state. */
+struct swm_bar_colors {
+	int			fg_type;
+	int			bg_type;
+	int			bd_type;
+	unsigned int		gen;	/* color_gen when resolved. */
+	int			nfg;
+	int			nbg;
+	uint32_t		*fg_pixel;
+	XftColor		**fg_xft;
+	uint32_t		*bg_pixel;
+	uint32_t		bd_pixel;
+};
+
 struct swm_bar {
 	struct swm_stackable	*st;	/* Always valid, never changes. */
 	xcb_window_t		id;
@@ -652,6 +840,22 @@ struct swm_bar {
 	struct swm_region	*r;	/* Associated region. */
 	bool			disabled;
 	xcb_pixmap_t		buffer;
+	xcb_gcontext_t		gc;	/* Fills/border on buffer. */
+	uint32_t		gc_fg;	/* Current gc foreground. */
+	uint32_t		gc_lw;	/* Current gc line width. */
+	XftDraw			*xft_draw; /* Created on first Xft draw. */
+	GC			legacy_gc; /* Created on first legacy draw. */
+	struct swm_bar_colors	colors;
+	bool			dirty;	/* Needs rendering. */
+	bool			drawn;	/* Buffer holds a rendered bar. */
+
+	/* What was last drawn; sections are NUL terminated back to back. */
+	char			*last_text;
+	size_t			last_len;
+	int			last_fg;
+	int			last_bg;
+	unsigned int		last_gen;
+	uint32_t		last_width;
 };
 
 /* virtual "screens" */
@@ -665,9 +869,17 @@ struct swm_region {
 	struct workspace	*ws_prior; /* prior workspace on this region */
 	struct swm_screen	*s;	/* screen idx */
 	struct swm_bar		*bar;
+	uint32_t		randr_id; /* CRTC or monitor, XCB_NONE if none. */
 };
 TAILQ_HEAD(swm_region_list, swm_region);
 
+/* Region wanted by a screen scan, matched against existing regions. */
+struct swm_region_spec {
+	uint32_t		randr_id;
+	struct swm_geometry	g;
+	bool			used;
+};
+
 struct swm_strut {
 	SLIST_ENTRY(swm_strut)	entry;
 	struct ws_win		*win;
@@ -687,10 +899,31 @@ struct swm_strut {
 };
 SLIST_HEAD(swm_strut_list, swm_strut);
 
+/*
+ * Cached top-level ancestor of a managed window's subwindow.  Subwindows
+ * are not covered by our SubstructureNotify selections, so StructureNotify
+ * is selected on each one walked; its Destroy/ReparentNotify drops them.
+ */
+struct subwin {
+	RB_ENTRY(subwin)	entry;
+	SLIST_ENTRY(subwin)	win_entry;
+	xcb_window_t		id;
+	xcb_window_t		top;	/* Top-level ancestor of id. */
+	struct ws_win		*win;	/* Managed window owning top. */
+};
+RB_HEAD(subwin_tree, subwin) subwins = RB_INITIALIZER(&subwins);
+SLIST_HEAD(subwin_list, subwin);
+
+#define SWM_SUBWIN_DEPTH_MAX	(16)
+
+TAILQ_HEAD(ws_win_list, ws_win);
 struct ws_win {
 	TAILQ_ENTRY(ws_win)	entry;
 	TAILQ_ENTRY(ws_win)	manage_entry;
 	TAILQ_ENTRY(ws_win)	focus_entry;
+	TAILQ_ENTRY(ws_win)	child_entry;	/* parent->children */
+	TAILQ_ENTRY(ws_win)	dependent_entry;/* main->dependents */
+	TAILQ_ENTRY(ws_win)	redirect_entry;	/* focus_redirect->redirects */
 	TAILQ_ENTRY(ws_win)	priority_entry;
 	TAILQ_ENTRY(ws_win)	iconify_entry;
 	struct swm_stackable	*st;	/* Always valid, never changes */
@@ -701,6 +934,10 @@ struct ws_win {
 	struct ws_win		*main;		/* Always valid. */
 	struct ws_win		*parent;	/* WM_TRANSIENT_FOR ws_win. */
 	struct ws_win		*focus_redirect;/* focus on transient */
+	struct ws_win_list	children;	/* Wins with us as parent. */
+	struct ws_win_list	dependents;	/* Wins with us as main. */
+	struct ws_win_list	redirects;	/* Wins redirecting to us. */
+	int			ws_refs;	/* # of ws focus references. */
 	struct swm_geometry	g;		/* current geometry */
 	struct swm_geometry	g_grav;		/* win-gravity reference. */
 	struct swm_geometry	g_float;	/* root coordinates */
@@ -709,6 +946,7 @@ struct ws_win {
 	bool			g_float_xy_valid;
 	uint8_t			gravity;
 	bool			mapped;
+	bool			parked;		/* Mapped, but moved off-screen. */
 	uint32_t		mapping;	/* # of pending operations */
 	uint32_t		unmapping;	/* # of pending operations */
 	uint32_t		state;		/* current ICCCM WM_STATE */
@@ -729,9 +967,11 @@ struct ws_win {
 	xcb_icccm_get_wm_class_reply_t	ch;
 	xcb_icccm_wm_hints_t	hints;
 	struct swm_strut	*strut;
+	struct subwin_list	subwins;	/* Cached subwindows. */
+	struct workspace	*count_ws;	/* ws holding our counts. */
+	uint8_t			count_state;	/* SWM_WCOUNT_* accounted. */
 	xcb_window_t		debug;	/* Debug overlay window. */
 };
-TAILQ_HEAD(ws_win_list, ws_win);
 
 /* pid goo */
 struct pid_e {
@@ -804,6 +1044,8 @@ struct workspace {
 	struct swm_region	*r;		/* may be NULL */
 	struct swm_region	*old_r;		/* may be NULL */
 	struct ws_win_list	winlist;	/* list of windows in ws */
+	int			win_count[SWM_WCOUNT_CLASSES];
+	int			urgent_count;	/* # of urgent windows */
 	char			*stacker;	/* stack_mark buffer */
 	size_t			stacker_len;
 	uint16_t		rotation;	/* Layout reference. */
@@ -872,6 +1114,24 @@ struct swm_color {
 	bool		manual;
 };
 
+/* Passive key grab currently held on a root window. */
+struct key_grab {
+	RB_ENTRY(key_grab)	entry;
+	xcb_keycode_t		keycode;
+	uint16_t		mod;
+	uint8_t			state;
+#define SWM_GRAB_STALE		(0)	/* No longer wanted. */
+#define SWM_GRAB_KEEP		(1)	/* Wanted and held. */
+#define SWM_GRAB_NEW		(2)	/* Wanted, needs GrabKey. */
+};
+RB_HEAD(key_grab_tree, key_grab);
+
+/* Root window property value as last written. */
+struct swm_root_prop {
+	void			*data;	/* NULL when unknown. */
+	uint32_t		len;	/* In bytes. */
+};
+
 struct swm_screen {
 	int			idx;	/* screen index */
 	xcb_window_t		root;
@@ -893,7 +1153,30 @@ struct swm_screen {
 	struct ws_win_list	iconified;	/* Iconified windows. */
 	struct ws_win_list	managed;	/* All client windows. */
 	int			managed_count;
+	uint32_t		ewmh_dirty;	/* Pending root updates. */
+	struct swm_root_prop	*root_props;	/* Indexed by ewmh hint. */
 	struct swm_strut_list	struts;
+	struct key_grab_tree	key_grabs;	/* Grabs held on root. */
+
+	/* Grid of region edges for region_under(), rebuilt on demand. */
+	struct swm_region_index {
+		int			*xs;	/* Sorted unique x edges. */
+		int			*ys;	/* Sorted unique y edges. */
+		int			nx;
+		int			ny;
+		struct swm_region	**cells; /* (nx - 1) * (ny - 1) */
+		bool			valid;
+	} ri;
+
+	/* Unmapped search indicators kept for reuse, parented to root. */
+	struct search_winlist	search_pool;
+
+	/* Digit glyphs and advances of bar_xftfonts[0] for indicators. */
+	struct search_digits {
+		XftFont			*font;
+		FT_UInt			glyph[10];
+		int			width[10];
+	} sd;
 
 	struct swm_color_type {
 		struct swm_color	**colors;
@@ -907,6 +1190,7 @@ struct swm_screen {
 	xcb_colormap_t		colormap;
 	xcb_gcontext_t		gc;
 	XftFont			**bar_xftfonts;
+	struct swm_xftfont	**bar_xftref;	/* NULL until first use. */
 };
 struct swm_screen	*screens;
 
@@ -1015,6 +1299,7 @@ TAILQ_HEAD(quirk_list, quirk) quirks = TAILQ_HEAD_INITIALIZER(quirks);
 enum {
 	_NET_ACTIVE_WINDOW,
 	_NET_CLIENT_LIST,
+	_NET_CLIENT_LIST_STACKING,
 	_NET_CLOSE_WINDOW,
 	_NET_CURRENT_DESKTOP,
 	_NET_DESKTOP_GEOMETRY,
@@ -1079,6 +1364,7 @@ struct ewmh_hint {
     /* must be in same order as in the enum */
     {"_NET_ACTIVE_WINDOW", XCB_ATOM_NONE},
     {"_NET_CLIENT_LIST", XCB_ATOM_NONE},
+    {"_NET_CLIENT_LIST_STACKING", XCB_ATOM_NONE},
     {"_NET_CLOSE_WINDOW", XCB_ATOM_NONE},
     {"_NET_CURRENT_DESKTOP", XCB_ATOM_NONE},
     {"_NET_DESKTOP_GEOMETRY", XCB_ATOM_NONE},
@@ -1394,6 +1680,14 @@ struct binding {
 };
 RB_HEAD(binding_tree, binding) bindings = RB_INITIALIZER(&bindings);
 
+/*
+ * Key bindings resolved per keycode, indexed by CLEANMASK() state. Rows are
+ * only allocated for keycodes that have a binding.
+ */
+#define SWM_KEY_DISPATCH_MODS	(UINT8_MAX + 1)
+struct binding		**key_dispatch[UINT8_MAX + 1];
+bool			key_dispatch_valid = false;
+
 struct atom_name {
 	RB_ENTRY(atom_name)	entry;
 	xcb_atom_t		atom;
@@ -1415,24 +1709,53 @@ static void	 atom_name_insert(xcb_atom_t, char *);
 static struct atom_name	*atom_name_lookup(xcb_atom_t);
 static void	 atom_name_remove(struct atom_name *);
 static void	 bar_cleanup(struct swm_region *);
+static struct swm_bar_colors	*bar_colors(struct swm_region *);
 static void	 bar_draw(struct swm_bar *);
 static void	 bar_extra_setup(void);
 static void	 bar_extra_stop(void);
 static int	 bar_extra_update(void);
+static char	*bar_segment_key(char *, char *);
+static const char	*bar_segment_lookup(const char *);
+static void	 bar_segments_clear(void);
+static bool	 bar_segment_set(char *, bool *);
+static struct bar_source	*bar_source_find(const char *);
+static void	 bar_source_free(struct bar_source *);
+static bool	 bar_source_read(struct bar_source *);
+static void	 bar_source_start(struct bar_source *);
+static void	 bar_source_stop(struct bar_source *);
+static void	 bar_sources_clear(void);
+static int	 bar_sources_pollfd(struct pollfd *);
+static bool	 bar_sources_read(struct pollfd *, int);
+static int	 bar_sources_schedule(int);
+static void	 bar_sources_update(void);
+static void	 bar_stat_battery(struct bar_stat *, char *);
+static int	 bar_stat_battery_open(void);
+static void	 bar_stat_close(void);
+static void	 bar_stat_cpu(struct bar_stat *, char *);
+static void	 bar_stat_human(char *, size_t, double);
+static void	 bar_stat_mem(struct bar_stat *, char *);
+static void	 bar_stat_net(struct bar_stat *, char *, double);
+static bool	 bar_stat_open(int);
+static void	 bar_stat_sample(int, double);
+static const char	*bar_stat_value(int);
+static void	 bar_flush(void);
 static void	 bar_fmt(const char *, char *, struct swm_region *, size_t);
 static void	 bar_fmt_expand(char *, size_t);
+static void	 bar_gc_set(struct swm_bar *, uint32_t, uint32_t);
 static void	 bar_parse_markup(struct swm_screen *s, struct bar_section *);
 static void	 bar_print(struct swm_region *, const char *);
 static void	 bar_print_layout(struct swm_region *);
 static void	 bar_print_legacy(struct swm_region *, const char *);
 static void	 bar_split_format(char *);
 static void	 bar_strlcat_esc(char *, char *, size_t, size_t *);
+static void	 bar_render(struct swm_bar *);
 static void	 bar_replace(char *, char *, struct swm_region *, size_t);
 static void	 bar_replace_action(char *, char *, struct swm_region *,
 		     size_t);
 static void	 bar_replace_pad(char *, size_t *, size_t);
 static char	*bar_replace_seq(char *, char *, struct swm_region *, size_t *,
 		     size_t);
+static void	 bar_set_geometry(struct swm_region *);
 static void	 bar_setup(struct swm_region *);
 static void	 bar_toggle(struct swm_screen *, struct binding *, union arg *);
 static void	 bar_urgent(struct swm_screen *, char *, size_t);
@@ -1463,15 +1786,24 @@ static void	 clear_atom_names(void);
 static void	 clear_attention(struct ws_win *);
 static void	 clear_bindings(void);
 static void	 clear_colors(struct swm_screen *);
+static void	 clear_key_grabs(struct swm_screen *);
 static void	 clear_keybindings(void);
 static void	 clear_quirks(void);
 static void	 clear_spawns(void);
 static void	 clear_stack(struct swm_screen *);
+static void	 clear_subwins(struct ws_win *);
 static void	 click_focus(struct swm_screen *, xcb_window_t, int, int);
 static void	 client_msg(struct ws_win *, xcb_atom_t, xcb_timestamp_t);
 static void	 clientmessage(xcb_client_message_event_t *);
 static char	*color_to_rgb(struct swm_color *);
+static uint32_t	 conf_hash(uint32_t, const char *);
 static int	 conf_load(const char *, int);
+static int	 conf_reload_class(int);
+static void	 conf_watch_add(const char *);
+static void	 conf_watch_clear(void);
+static void	 conf_watch_read(void);
+static bool	 conf_watch_settled(void);
+static int	 conf_watch_timeout(int);
 static void	 config_master(struct workspace *, int, int);
 static void	 config_win(struct ws_win *, xcb_configure_request_event_t *);
 static void	 configurenotify(xcb_configure_notify_event_t *);
@@ -1499,11 +1831,17 @@ static void	 event_error(xcb_generic_error_t *);
 static void	 event_handle(xcb_generic_event_t *);
 static uint32_t	 ewmh_apply_flags(struct ws_win *, uint32_t);
 static uint32_t	 ewmh_change_wm_state(struct ws_win *, xcb_atom_t, long);
+static void	 ewmh_client_list_add(struct ws_win *);
+static void	 ewmh_flush(struct swm_screen *);
 static void	 ewmh_get_desktop_names(struct swm_screen *);
 static void	 ewmh_get_strut(struct ws_win *);
 static void	 ewmh_get_window_type(struct ws_win *);
 static void	 ewmh_get_wm_state(struct ws_win *);
 static void	 ewmh_print_window_type(uint32_t);
+static void	 ewmh_root_prop_clear(struct swm_screen *, int);
+static void	 ewmh_set_desktop_names(struct swm_screen *);
+static void	 ewmh_set_root_prop(struct swm_screen *, int, xcb_atom_t,
+		     uint8_t, uint32_t, const void *);
 static void	 ewmh_update_actions(struct ws_win *);
 static void	 ewmh_update_active_window(struct swm_screen *);
 static void	 ewmh_update_client_list(struct swm_screen *);
@@ -1551,6 +1889,7 @@ static void	 free_window(struct ws_win *);
 static void	 fullscreen_toggle(struct swm_screen *, struct binding *,
 		     union arg *);
 static xcb_atom_t	 get_atom_from_string(const char *);
+static void	 get_atoms_from_strings(const char **, xcb_atom_t **, int);
 static const char	*get_atom_label(xcb_atom_t);
 static char	*get_atom_name(xcb_atom_t);
 static struct swm_geometry	 get_boundary(struct ws_win *);
@@ -1571,6 +1910,7 @@ static const char	*get_input_event_label(xcb_ge_generic_event_t *);
 static xcb_window_t	 get_input_focus(void);
 static xcb_atom_t	 get_intern_atom(const char *);
 static xcb_keycode_t	 get_keysym_keycode(xcb_keysym_t);
+static int	 get_keysyms_per_keycode(void);
 static struct ws_win	*get_main_window(struct workspace *);
 static const char	*get_mapping_notify_label(uint8_t);
 static const char	*get_moveresize_direction_label(uint32_t);
@@ -1579,6 +1919,8 @@ static const char	*get_notify_detail_label(uint8_t);
 static const char	*get_notify_mode_label(uint8_t);
 static struct swm_region	*get_pointer_region(struct swm_screen *);
 static struct ws_win	*get_pointer_win(struct swm_screen *);
+static bool	 get_pointer(struct swm_screen *, bool, int *, int *,
+    xcb_window_t *);
 static const char	*get_randr_event_label(xcb_generic_event_t *);
 static const char	*get_randr_rotation_label(int);
 static struct swm_region	*get_region(struct swm_screen *, int);
@@ -1611,13 +1953,19 @@ static void	 grabbuttons(void);
 static void	 grabkeys(void);
 static void	 iconify(struct swm_screen *, struct binding *, union arg *);
 static bool	 isxlfd(char *);
+static void	 key_dispatch_build(void);
+static void	 key_dispatch_clear(void);
+static int	 key_grab_cmp(struct key_grab *, struct key_grab *);
+static void	 key_grab_want(struct swm_screen *, xcb_keycode_t, uint16_t);
 static bool	 keybindreleased(struct binding *, xcb_key_release_event_t *);
 static void	 keypress(xcb_key_press_event_t *);
 static void	 keyrelease(xcb_key_release_event_t *);
 static bool	 keyrepeating(xcb_key_release_event_t *);
+static void	 keymap_refresh(void);
 static void	 kill_bar_extra_atexit(void);
 static void	 kill_refs(struct ws_win *);
 static void	 kill_refs_region(struct swm_region *);
+static void	 kill_stale_refs(struct ws_win *);
 static void	 layout_order_reset(void);
 static void	 leavenotify(xcb_leave_notify_event_t *);
 static void	 load_defaults(void);
@@ -1637,8 +1985,8 @@ static void	 move_win_pointer(struct ws_win *, struct binding *, uint32_t,
 static void	 moveresize_win(struct ws_win *, xcb_client_message_event_t *);
 static void	 name_workspace(struct swm_screen *, struct binding *,
 		     union arg *);
-static void	 new_region(struct swm_screen *, int16_t, int16_t, uint16_t,
-		     uint16_t, uint16_t);
+static struct swm_region	*new_region(struct swm_screen *, int16_t, int16_t,
+		     uint16_t, uint16_t, uint16_t);
 static int	 parse_color(struct swm_screen *, const char *,
 		     struct swm_color *);
 static int	 parse_focus_types(const char *, uint32_t *, char **);
@@ -1659,6 +2007,7 @@ static void	 print_clientmessage(xcb_client_message_event_t *);
 static void	 print_stackable(struct swm_stackable *);
 static void	 print_stacking(struct swm_screen *);
 static void	 print_strut(struct swm_strut *);
+static bool	 pending_raw_input_only(void);
 static void	 print_win_geom(xcb_window_t);
 static void	 prioritize_window(struct ws_win *);
 static void	 priorws(struct swm_screen *, struct binding *, union arg *);
@@ -1682,9 +2031,14 @@ static void	 reapply_quirks(struct ws_win *);
 static void	 refresh_stack(struct swm_screen *);
 static int	 refresh_strut(struct swm_screen *);
 static int	 regcompopt(regex_t *, const char *);
+static int	 region_index_bisect(int *, int, int);
+static void	 region_index_build(struct swm_screen *);
+static int	 region_index_cmp(const void *, const void *);
+static void	 region_index_free(struct swm_screen *);
 static struct swm_region	*region_under(struct swm_screen *, int, int);
 static void	 regionize(struct ws_win *, int, int);
 static void	 reload(struct swm_screen *, struct binding *, union arg *);
+static void	 remove_region(struct swm_region *);
 static int	 reparent_window(struct ws_win *);
 static void	 reparentnotify(xcb_reparent_notify_event_t *);
 static void	 resize(struct swm_screen *, struct binding *, union arg *);
@@ -1696,7 +2050,7 @@ static bool	 rg_root(struct swm_region *);
 static void	 rotatews(struct workspace *, uint16_t);
 static char	*scan_config(void);
 static bool	 scan_markup(struct swm_screen *, char *, int *, size_t *);
-static void	 scan_randr(struct swm_screen *);
+static bool	 scan_randr(struct swm_screen *);
 static void	 screenchange(xcb_randr_screen_change_notify_event_t *);
 static void	 search_do_resp(void);
 static void	 search_resp_name_workspace(const char *, size_t);
@@ -1705,6 +2059,10 @@ static void	 search_resp_search_workspace(const char *);
 static void	 search_resp_uniconify(const char *, size_t);
 static void	 search_win(struct swm_screen *, struct binding *, union arg *);
 static void	 search_win_cleanup(void);
+static void	 search_win_detach(struct ws_win *);
+static void	 search_win_pool_free(struct swm_screen *);
+static void	 search_win_put(struct search_window *);
+static void	 search_digits_init(struct swm_screen *);
 static void	 search_workspace(struct swm_screen *, struct binding *,
 		     union arg *);
 static void	 send_to_rg(struct swm_screen *, struct binding *, union arg *);
@@ -1722,6 +2080,8 @@ static void	 set_win_state(struct ws_win *, uint32_t);
 static int	 setautorun(uint8_t, const char *, const char *, int, char **);
 static void	 setbinding(uint16_t, enum binding_type, uint32_t, uint32_t,
 		     enum actionid, int, const char *);
+static int	 setconfbarsource(uint8_t, const char *, const char *, int,
+    char **);
 static int	 setconfbinding(uint8_t, const char *, const char *, int,
 		     char **);
 static int	 setconfcancelkey(uint8_t, const char *, const char *, int,
@@ -1785,9 +2145,15 @@ static void	 stack_config(struct swm_screen *, struct binding *,
 static struct ws_win	*stack_column(struct swm_geometry *, struct ws_win *,
 		     int, bool);
 static void	 stack_master(struct workspace *, struct swm_geometry *, bool);
+static void	 startup_phase(const char *);
 static void	 store_float_geom(struct ws_win *);
 static char	*strdupsafe(const char *);
 static int32_t	 strtoint32(const char *, int32_t, int32_t, int *);
+static int	 subwin_cmp(struct subwin *, struct subwin *);
+static void	 subwin_insert(xcb_window_t, xcb_window_t, struct ws_win *);
+static void	 subwin_invalidate(xcb_window_t);
+static struct subwin	*subwin_lookup(xcb_window_t);
+static void	 subwin_remove(struct subwin *);
 static void	 swapwin(struct swm_screen *, struct binding *, union arg *);
 static void	 switch_workspace(struct swm_region *, struct workspace *, bool,
 		     bool);
@@ -1798,6 +2164,8 @@ static void	 teardown_ewmh(void);
 static void	 transfer_win(struct ws_win *, struct workspace *);
 static char	*trimopt(char *);
 static void	 update_mapping(struct swm_screen *);
+static void	 update_region_geometry(struct swm_region *,
+		     struct swm_geometry *);
 static void	 update_region_mapping(struct swm_region *);
 static void	 update_stacking(struct swm_screen *);
 static void	 unescape_selector(char *);
@@ -1810,6 +2178,9 @@ static void	 uniconify_win(struct ws_win *);
 static void	 unmanage_window(struct ws_win *);
 static void	 unmap_window(struct ws_win *);
 static void	 unmap_workspace(struct workspace *);
+static bool	 park_window(struct ws_win *);
+static void	 hide_window(struct ws_win *);
+static int32_t	 win_frame_x(struct ws_win *);
 static void	 unmapnotify(xcb_unmap_notify_event_t *);
 static void	 unparent_window(struct ws_win *);
 static void	 unsnap_win(struct ws_win *, bool);
@@ -1848,7 +2219,12 @@ static bool	 win_prioritized(struct ws_win *);
 static bool	 win_raised(struct ws_win *);
 static bool	 win_related(struct ws_win *, struct ws_win *);
 static bool	 win_reparented(struct ws_win *);
+static void	 win_set_focus_redirect(struct ws_win *, struct ws_win *);
+static void	 win_set_main(struct ws_win *, struct ws_win *);
+static void	 win_set_parent(struct ws_win *, struct ws_win *);
 static bool	 win_tiled(struct ws_win *);
+static void	 win_count_remove(struct ws_win *);
+static void	 win_count_update(struct ws_win *);
 static void	 win_to_ws(struct ws_win *, struct workspace *, uint32_t);
 static bool	 win_transient(struct ws_win *);
 static bool	 win_urgent(struct ws_win *);
@@ -1864,8 +2240,19 @@ static bool	 ws_maponfocus(struct workspace *);
 static bool	 ws_maxstack(struct workspace *);
 static bool	 ws_maxstack_prior(struct workspace *);
 static bool	 ws_root(struct workspace *);
+static void	 ws_set_focus(struct workspace *, struct ws_win *);
+static void	 ws_set_focus_raise(struct workspace *, struct ws_win *);
+static XftFont	*xft_font(struct swm_screen *, int);
+static struct swm_xftfont	*xft_font_get(struct swm_screen *, const char *,
+		    bool);
+static void	 xft_fonts_prune(void);
 static void	 xft_free(struct swm_screen *);
 static int	 xft_init(struct swm_screen *);
+static bool	 xft_screen_match(int, int);
+#ifdef SWM_XCB_HAS_XKB
+static void	 xkbevent(xcb_generic_event_t *);
+#endif
+static void	 xft_init_colors(struct swm_screen *);
 static void	 _add_startup_exception(const char *, va_list);
 static void	 add_startup_exception(const char *, ...);
 static void	 clear_startup_exceptions(void);
@@ -1873,10 +2260,14 @@ static void	 clear_startup_exceptions(void);
 RB_PROTOTYPE_STATIC(binding_tree, binding, entry, binding_cmp);
 RB_PROTOTYPE_STATIC(atom_name_tree, atom_name, entry, atom_name_cmp);
 RB_PROTOTYPE_STATIC(workspace_tree, workspace, entry, workspace_cmp);
+RB_PROTOTYPE_STATIC(subwin_tree, subwin, entry, subwin_cmp);
+RB_PROTOTYPE_STATIC(key_grab_tree, key_grab, entry, key_grab_cmp);
 
 RB_GENERATE_STATIC(binding_tree, binding, entry, binding_cmp);
 RB_GENERATE_STATIC(atom_name_tree, atom_name, entry, atom_name_cmp);
 RB_GENERATE_STATIC(workspace_tree, workspace, entry, workspace_cmp);
+RB_GENERATE_STATIC(subwin_tree, subwin, entry, subwin_cmp);
+RB_GENERATE_STATIC(key_grab_tree, key_grab, entry, key_grab_cmp);
 
 static bool
 win_free(struct ws_win *win)
@@ -2356,11 +2747,13 @@ flush(void)
 		case XCB_ENTER_NOTIFY:
 			event_time = ((xcb_enter_notify_event_t *)e)->time;
 			pointer_window = ((xcb_enter_notify_event_t *)e)->event;
+			pointer_cache.valid = false;
 			DNPRINTF(SWM_D_EVENT, "pointer_window: %#x\n",
 			    pointer_window);
 			break;
 		case XCB_MOTION_NOTIFY:
 			event_time = ((xcb_motion_notify_event_t *)e)->time;
+			pointer_cache.valid = false;
 			break;
 		default:
 			event_handle(e);
@@ -2489,6 +2882,38 @@ get_atom_from_string(const char *str)
 	return (atom);
 }
 
+/* Intern a set of atoms; all requests are sent before any reply is read. */
+static void
+get_atoms_from_strings(const char **names, xcb_atom_t **atoms, int n)
+{
+	xcb_intern_atom_cookie_t	*c;
+	xcb_intern_atom_reply_t		*r;
+	char				*name;
+	int				i;
+
+	if ((c = calloc(n, sizeof *c)) == NULL)
+		err(1, "get_atoms_from_strings: calloc");
+
+	for (i = 0; i < n; i++)
+		c[i] = xcb_intern_atom(conn, 0, strlen(names[i]), names[i]);
+
+	for (i = 0; i < n; i++) {
+		*atoms[i] = XCB_ATOM_NONE;
+		if ((r = xcb_intern_atom_reply(conn, c[i], NULL)) == NULL)
+			continue;
+		*atoms[i] = r->atom;
+		free(r);
+
+		if (*atoms[i] != XCB_ATOM_NONE &&
+		    atom_name_lookup(*atoms[i]) == NULL) {
+			if ((name = strdup(names[i])) == NULL)
+				err(1, "get_atoms_from_strings: strdup");
+			atom_name_insert(*atoms[i], name);
+		}
+	}
+	free(c);
+}
+
 static const char *
 get_atom_label(xcb_atom_t atom)
 {
@@ -2529,10 +2954,12 @@ static void
 setup_ewmh(void)
 {
 	xcb_window_t			root, swmwin;
-	int				i, j, num_screens;
+	xcb_atom_t			supported[SWM_EWMH_HINT_MAX];
+	int				i, num_screens;
 
+	/* ewmh[] atoms are interned by setup_globals(). */
 	for (i = 0; i < LENGTH(ewmh); i++)
-		ewmh[i].atom = get_atom_from_string(ewmh[i].name);
+		supported[i] = ewmh[i].atom;
 
 	num_screens = get_screen_count();
 	for (i = 0; i < num_screens; i++) {
@@ -2549,15 +2976,16 @@ setup_ewmh(void)
 		    a_net_wm_check, XCB_ATOM_WINDOW, 32, 1, &swmwin);
 
 		/* Report supported atoms */
-		xcb_delete_property(conn, root, a_net_supported);
-		for (j = 0; j < LENGTH(ewmh); j++)
-			xcb_change_property(conn, XCB_PROP_MODE_APPEND, root,
-			    a_net_supported, XCB_ATOM_ATOM, 32, 1,
-			    &ewmh[j].atom);
+		xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root,
+		    a_net_supported, XCB_ATOM_ATOM, 32, LENGTH(supported),
+		    supported);
 
 		ewmh_update_number_of_desktops(&screens[i]);
 		ewmh_get_desktop_names(&screens[i]);
 		ewmh_update_desktop_viewports(&screens[i]);
+
+		/* Replace any client list left over from a previous run. */
+		ewmh_update_client_list(&screens[i]);
 	}
 }
 
@@ -2720,6 +3148,7 @@ ewmh_apply_flags(struct ws_win *win, uint32_t pending)
 	DNPRINTF(SWM_D_PROP, "pending: %u\n", pending);
 
 	win->ewmh_flags = pending;
+	win_count_update(win);
 
 	if (changed & EWMH_F_HIDDEN) {
 		if (HIDDEN(win)) {
@@ -2994,6 +3423,7 @@ ewmh_get_wm_state(struct ws_win *win)
 		return;
 
 	win->ewmh_flags = 0;
+	win_count_update(win);
 
 	c = xcb_get_property(conn, 0, win->id, ewmh[_NET_WM_STATE].atom,
 	    XCB_ATOM_ATOM, 0, UINT32_MAX);
@@ -3023,10 +3453,8 @@ ewmh_update_active_window(struct swm_screen *s)
 	if (awid != s->active_window) {
 		DNPRINTF(SWM_D_FOCUS, "root: %#x win: %#x\n", s->root,
 		    s->active_window);
-		xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
-		    ewmh[_NET_ACTIVE_WINDOW].atom, XCB_ATOM_WINDOW, 32, 1,
-		    &awid);
 		s->active_window = awid;
+		s->ewmh_dirty |= SWM_EWMH_DIRTY_ACTIVE_WINDOW;
 	}
 }
 
@@ -3378,6 +3806,10 @@ sighdlr(int sig)
 		break;
 	}
 
+	/* Wake up the main loop; a full pipe already has a wakeup pending. */
+	if (sig_pipe[1] != -1)
+		(void)write(sig_pipe[1], "", 1);
+
 	errno = saved_errno;
 }
 
@@ -3561,6 +3993,7 @@ setscreencolor(struct swm_screen *s, const char *val, int c, int i)
 	if (s->c[c].colors[i])
 		free(s->c[c].colors[i]);
 	s->c[c].colors[i] = color;
+	color_gen++;
 
 	DNPRINTF(SWM_D_CONF, "set c[%d][%d] r:%#x g:%#x b:%#x a:%#x pixel:%#x\n",
 	    c, i, color->r, color->g, color->b, color->a, color->pixel);
@@ -3577,6 +4010,7 @@ freecolortype(struct swm_screen *s, int c)
 
 	s->c[c].colors = NULL;
 	s->c[c].count = 0;
+	color_gen++;
 }
 
 static struct swm_color *
@@ -3735,16 +4169,96 @@ socket_setnonblock(int fd)
 		err(1, "fcntl F_SETFL");
 }
 
+/* Set the bar gc foreground/line width, skipping unchanged values. */
+static void
+bar_gc_set(struct swm_bar *bar, uint32_t fg, uint32_t lw)
+{
+	uint32_t		mask = 0, gcv[2];
+	int			n = 0;
+
+	if (bar->gc_fg != fg) {
+		mask |= XCB_GC_FOREGROUND;
+		gcv[n++] = bar->gc_fg = fg;
+	}
+	if (bar->gc_lw != lw) {
+		mask |= XCB_GC_LINE_WIDTH;
+		gcv[n++] = bar->gc_lw = lw;
+	}
+
+	if (mask)
+		xcb_change_gc(conn, bar->gc, mask, gcv);
+}
+
+/* Colors for the region's bar in its current state; resolved on change. */
+static struct swm_bar_colors *
+bar_colors(struct swm_region *r)
+{
+	struct swm_bar_colors	*bc = &r->bar->colors;
+	struct swm_screen	*s = r->s;
+	int			fg_type, bg_type, bd_type, i;
+
+	if (win_free(s->focus) && s->r_focus == r) {
+		fg_type = SWM_S_COLOR_BAR_FONT_FREE;
+		bg_type = SWM_S_COLOR_BAR_FREE;
+		bd_type = SWM_S_COLOR_BAR_BORDER_FREE;
+	} else if (ws_focused(r->ws)) {
+		fg_type = SWM_S_COLOR_BAR_FONT;
+		bg_type = SWM_S_COLOR_BAR;
+		bd_type = SWM_S_COLOR_BAR_BORDER;
+	} else {
+		fg_type = SWM_S_COLOR_BAR_FONT_UNFOCUS;
+		bg_type = SWM_S_COLOR_BAR_UNFOCUS;
+		bd_type = SWM_S_COLOR_BAR_BORDER_UNFOCUS;
+	}
+
+	if (bc->gen == color_gen && bc->fg_type == fg_type &&
+	    bc->bg_type == bg_type && bc->bd_type == bd_type)
+		return (bc);
+
+	DNPRINTF(SWM_D_BAR, "resolve fg: %d, bg: %d, bd: %d\n", fg_type,
+	    bg_type, bd_type);
+
+	/* Markup indexes are bounded by the focused bar color counts. */
+	bc->nfg = s->c[SWM_S_COLOR_BAR_FONT].count;
+	bc->nbg = s->c[SWM_S_COLOR_BAR].count;
+	if (bc->nfg < 1)
+		bc->nfg = 1;
+	if (bc->nbg < 1)
+		bc->nbg = 1;
+
+	free(bc->fg_pixel);
+	free(bc->fg_xft);
+	free(bc->bg_pixel);
+	if ((bc->fg_pixel = calloc(bc->nfg, sizeof *bc->fg_pixel)) == NULL ||
+	    (bc->fg_xft = calloc(bc->nfg, sizeof *bc->fg_xft)) == NULL ||
+	    (bc->bg_pixel = calloc(bc->nbg, sizeof *bc->bg_pixel)) == NULL)
+		err(1, "bar_colors: calloc");
+
+	for (i = 0; i < bc->nfg; i++) {
+		bc->fg_pixel[i] = getcolorpixel(s, fg_type, i);
+		bc->fg_xft[i] = getcolorxft(s, fg_type, i);
+	}
+	for (i = 0; i < bc->nbg; i++)
+		bc->bg_pixel[i] = getcolorpixel(s, bg_type, i);
+	bc->bd_pixel = getcolorpixel(s, bd_type, 0);
+
+	bc->fg_type = fg_type;
+	bc->bg_type = bg_type;
+	bc->bd_type = bd_type;
+	bc->gen = color_gen;
+
+	return (bc);
+}
+
 static void
 bar_print_legacy(struct swm_region *r, const char *s)
 {
+	struct swm_bar_colors	*bc;
 	xcb_rectangle_t		rect;
-	uint32_t		gcv[1];
 	XGCValues		gcvd;
-	int			x = 0, fg_type, bg_type;
+	int			x = 0;
 	size_t			len;
 	XRectangle		ibox, lbox;
-	GC			draw;
 
 	len = strlen(s);
 	TEXTEXTENTS(bar_fs, s, len, &ibox, &lbox);
@@ -3764,17 +4278,7 @@ bar_print_legacy(struct swm_region *r, const char *s)
 	if (x < SWM_BAR_OFFSET)
 		x = SWM_BAR_OFFSET;
 
-	/* Setup default fg/bg index type */
-	if (win_free(r->s->focus) && r->s->r_focus == r) {
-		fg_type = SWM_S_COLOR_BAR_FONT_FREE;
-		bg_type = SWM_S_COLOR_BAR_FREE;
-	} else if (ws_focused(r->ws)) {
-		fg_type = SWM_S_COLOR_BAR_FONT;
-		bg_type = SWM_S_COLOR_BAR;
-	} else {
-		fg_type = SWM_S_COLOR_BAR_FONT_UNFOCUS;
-		bg_type = SWM_S_COLOR_BAR_UNFOCUS;
-	}
+	bc = bar_colors(r);
 
 	/* clear back buffer */
 	rect.x = 0;
@@ -3782,21 +4286,23 @@ bar_print_legacy(struct swm_region *r, const char *s)
 	rect.width = WIDTH(r->bar);
 	rect.height = HEIGHT(r->bar);
 
-	gcv[0] = getcolorpixel(r->s, bg_type, 0);
-	xcb_change_gc(conn, r->s->gc, XCB_GC_FOREGROUND, gcv);
-	xcb_poly_fill_rectangle(conn, r->bar->buffer, r->s->gc, 1, &rect);
+	bar_gc_set(r->bar, bc->bg_pixel[0], r->bar->gc_lw);
+	xcb_poly_fill_rectangle(conn, r->bar->buffer, r->bar->gc, 1, &rect);
 
 	/* draw back buffer */
-	gcvd.graphics_exposures = 0;
-	draw = XCreateGC(display, r->bar->buffer, GCGraphicsExposures, &gcvd);
-	XSetForeground(display, draw, getcolorpixel(r->s, fg_type, 0));
-	DRAWSTRING(display, r->bar->buffer, bar_fs, draw,
+	if (r->bar->legacy_gc == NULL) {
+		gcvd.graphics_exposures = 0;
+		r->bar->legacy_gc = XCreateGC(display, r->bar->buffer,
+		    GCGraphicsExposures, &gcvd);
+	} else
+		XSetClipMask(display, r->bar->legacy_gc, None);
+	XSetForeground(display, r->bar->legacy_gc, bc->fg_pixel[0]);
+	DRAWSTRING(display, r->bar->buffer, bar_fs, r->bar->legacy_gc,
 	    x, (bar_fs_extents->max_logical_extent.height - lbox.height) / 2 -
 	    lbox.y, s, len);
-	XFreeGC(display, draw);
 
 	/* blt */
-	xcb_copy_area(conn, r->bar->buffer, r->bar->id, r->s->gc, 0, 0,
+	xcb_copy_area(conn, r->bar->buffer, r->bar->id, r->bar->gc, 0, 0,
 	    0, 0, WIDTH(r->bar), HEIGHT(r->bar));
 }
 
@@ -3805,10 +4311,8 @@ bar_print(struct swm_region *r, const char *s)
 {
 	size_t				len;
 	xcb_rectangle_t			rect;
-	uint32_t			gcv[1];
 	int32_t				x = 0;
 	XGlyphInfo			info;
-	XftDraw				*draw;
 	XftFont				*xf;
 
 	len = strlen(s);
@@ -3837,22 +4341,22 @@ bar_print(struct swm_region *r, const char *s)
 	rect.width = WIDTH(r->bar) + 2 * bar_border_width;
 	rect.height = HEIGHT(r->bar) + 2 * bar_border_width;
 
-	gcv[0] = getcolorpixel(r->s, SWM_S_COLOR_BAR, 0);
-	xcb_change_gc(conn, r->s->gc, XCB_GC_FOREGROUND, gcv);
-	xcb_poly_fill_rectangle(conn, r->bar->buffer, r->s->gc, 1, &rect);
+	bar_gc_set(r->bar, getcolorpixel(r->s, SWM_S_COLOR_BAR, 0),
+	    r->bar->gc_lw);
+	xcb_poly_fill_rectangle(conn, r->bar->buffer, r->bar->gc, 1, &rect);
 
 	/* draw back buffer */
-	draw = XftDrawCreate(display, r->bar->buffer, r->s->xvisual,
-	    r->s->colormap);
-
-	XftDrawStringUtf8(draw, getcolorxft(r->s, SWM_S_COLOR_BAR_FONT, 0), xf,
-	    x, (HEIGHT(r->bar) + xf->height) / 2 - xf->descent, (FcChar8 *)s,
-	    len);
+	if (r->bar->xft_draw == NULL)
+		r->bar->xft_draw = XftDrawCreate(display, r->bar->buffer,
+		    r->s->xvisual, r->s->colormap);
+	XftDrawSetClip(r->bar->xft_draw, NULL);
 
-	XftDrawDestroy(draw);
+	XftDrawStringUtf8(r->bar->xft_draw, getcolorxft(r->s,
+	    SWM_S_COLOR_BAR_FONT, 0), xf, x, (HEIGHT(r->bar) + xf->height) / 2 -
+	    xf->descent, (FcChar8 *)s, len);
 
 	/* blt */
-	xcb_copy_area(conn, r->bar->buffer, r->bar->id, r->s->gc, 0, 0, 0, 0,
+	xcb_copy_area(conn, r->bar->buffer, r->bar->id, r->bar->gc, 0, 0, 0, 0,
 	    WIDTH(r->bar) + 2 * bar_border_width,
 	    HEIGHT(r->bar) + 2 * bar_border_width);
 }
@@ -3860,17 +4364,16 @@ bar_print(struct swm_region *r, const char *s)
 static void
 bar_print_layout(struct swm_region *r)
 {
+	struct swm_bar		*bar = r->bar;
+	struct swm_bar_colors	*bc;
 	struct text_fragment	*frag;
 	xcb_rectangle_t		rect;
 	xcb_point_t		points[5];
-	XftDraw			*xft_draw = NULL;
 	XRectangle		x_rect;
 	XftFont			*xf;
-	GC			draw = 0;
 	XGCValues		gcvd;
-	uint32_t		gcv[2];
 	int			xpos, i, j;
-	int			bd_type, bg, bg_type, fg, fg_type, fn;
+	int			bg, fg, fn;
 	int 			space, remain, weight;
 
 	space = WIDTH(r) - 2 * (bar_border_width + bar_padding_horizontal);
@@ -3928,38 +4431,26 @@ bar_print_layout(struct swm_region *r)
 		xpos += bsect[i].width;
 	}
 
-	/* Create drawing context */
+	/* Drawing contexts live as long as the bar. */
 	if (bar_font_legacy) {
-		gcvd.graphics_exposures = 0;
-		draw = XCreateGC(display, r->bar->buffer, GCGraphicsExposures,
-		    &gcvd);
-	} else
-		xft_draw = XftDrawCreate(display, r->bar->buffer, r->s->xvisual,
-		    r->s->colormap);
+		if (bar->legacy_gc == NULL) {
+			gcvd.graphics_exposures = 0;
+			bar->legacy_gc = XCreateGC(display, bar->buffer,
+			    GCGraphicsExposures, &gcvd);
+		}
+	} else if (bar->xft_draw == NULL)
+		bar->xft_draw = XftDrawCreate(display, bar->buffer,
+		    r->s->xvisual, r->s->colormap);
 
-	/* Setup default fg/bg index type */
-	if (win_free(r->s->focus) && r->s->r_focus == r) {
-		fg_type = SWM_S_COLOR_BAR_FONT_FREE;
-		bg_type = SWM_S_COLOR_BAR_FREE;
-		bd_type = SWM_S_COLOR_BAR_BORDER_FREE;
-	} else if (ws_focused(r->ws)) {
-		fg_type = SWM_S_COLOR_BAR_FONT;
-		bg_type = SWM_S_COLOR_BAR;
-		bd_type = SWM_S_COLOR_BAR_BORDER;
-	} else {
-		fg_type = SWM_S_COLOR_BAR_FONT_UNFOCUS;
-		bg_type = SWM_S_COLOR_BAR_UNFOCUS;
-		bd_type = SWM_S_COLOR_BAR_BORDER_UNFOCUS;
-	}
+	bc = bar_colors(r);
 
 	/* Paint entire bar with default background color */
 	rect.x = bar_border_width;
 	rect.y = bar_border_width;
-	rect.width = WIDTH(r->bar);
-	rect.height = HEIGHT(r->bar);
-	gcv[0] = getcolorpixel(r->s, bg_type, 0);
-	xcb_change_gc(conn, r->s->gc, XCB_GC_FOREGROUND, gcv);
-	xcb_poly_fill_rectangle(conn, r->bar->buffer, r->s->gc, 1, &rect);
+	rect.width = WIDTH(bar);
+	rect.height = HEIGHT(bar);
+	bar_gc_set(bar, bc->bg_pixel[0], bar->gc_lw);
+	xcb_poly_fill_rectangle(conn, bar->buffer, bar->gc, 1, &rect);
 
 	/* Draw border. */
 	if (bar_border_width > 0) {
@@ -3971,12 +4462,9 @@ bar_print_layout(struct swm_region *r)
 		points[3].x = points[0].x;
 		points[3].y = points[2].y;
 		points[4] = points[0];
-		gcv[0] = getcolorpixel(r->s, bd_type, 0);
-		gcv[1] = bar_border_width;
-		xcb_change_gc(conn, r->s->gc,
-		    XCB_GC_FOREGROUND | XCB_GC_LINE_WIDTH, gcv);
-		xcb_poly_line(conn, XCB_COORD_MODE_ORIGIN, r->bar->buffer,
-		    r->s->gc, 5, points);
+		bar_gc_set(bar, bc->bd_pixel, bar_border_width);
+		xcb_poly_line(conn, XCB_COORD_MODE_ORIGIN, bar->buffer,
+		    bar->gc, 5, points);
 	}
 
 	/* Display the text for each section */
@@ -4000,10 +4488,11 @@ bar_print_layout(struct swm_region *r)
 		x_rect.width = rect.width;
 		x_rect.height = rect.height;
 		if (bar_font_legacy)
-			XSetClipRectangles(display, draw, 0, 0, &x_rect, 1,
-			    YXBanded);
+			XSetClipRectangles(display, bar->legacy_gc, 0, 0,
+			    &x_rect, 1, YXBanded);
 		else
-			XftDrawSetClipRectangles(xft_draw, 0, 0, &x_rect, 1);
+			XftDrawSetClipRectangles(bar->xft_draw, 0, 0, &x_rect,
+			    1);
 
 		/* Draw the text fragments in the current section */
 		xpos = bar_border_width + bsect[i].text_start;
@@ -4013,31 +4502,35 @@ bar_print_layout(struct swm_region *r)
 			fg = frag->fg;
 			bg = frag->bg;
 
+			/* Markup is validated against the focused counts. */
+			if (fg >= bc->nfg)
+				fg = 0;
+			if (bg >= bc->nbg)
+				bg = 0;
+
 			/* Paint background color of the text fragment  */
 			if (bg != 0) {
 				rect.x = xpos;
 				rect.width = frag->width;
-				gcv[0] = getcolorpixel(r->s, bg_type, bg);
-				xcb_change_gc(conn, r->s->gc, XCB_GC_FOREGROUND,
-				    gcv);
-				xcb_poly_fill_rectangle(conn, r->bar->buffer,
-				    r->s->gc, 1, &rect);
+				bar_gc_set(bar, bc->bg_pixel[bg], bar->gc_lw);
+				xcb_poly_fill_rectangle(conn, bar->buffer,
+				    bar->gc, 1, &rect);
 			}
 
 			/* Draw text  */
 			if (bar_font_legacy) {
-				XSetForeground(display, draw,
-				    getcolorpixel(r->s, fg_type, fg));
-				DRAWSTRING(display, r->bar->buffer, bar_fs,
-				    draw, xpos, bar_border_width +
+				XSetForeground(display, bar->legacy_gc,
+				    bc->fg_pixel[fg]);
+				DRAWSTRING(display, bar->buffer, bar_fs,
+				    bar->legacy_gc, xpos, bar_border_width +
 				    (bar_fs_extents->max_logical_extent.height
 				    - bsect[i].height) / 2 - bsect[i].ypos,
 				    frag->text, frag->length);
 			} else {
 				xf = r->s->bar_xftfonts[fn];
-				XftDrawStringUtf8(xft_draw, getcolorxft(r->s,
-				    fg_type, fg), xf, xpos, bar_border_width +
-				    (HEIGHT(r->bar) + xf->height) / 2
+				XftDrawStringUtf8(bar->xft_draw, bc->fg_xft[fg],
+				    xf, xpos, bar_border_width +
+				    (HEIGHT(bar) + xf->height) / 2
 				    - xf->descent, (FcChar8 *)frag->text,
 				    frag->length);
 			}
@@ -4046,15 +4539,10 @@ bar_print_layout(struct swm_region *r)
 		}
 	}
 
-	if (bar_font_legacy)
-		XFreeGC(display, draw);
-	else
-		XftDrawDestroy(xft_draw);
-
 	/* blt */
-	xcb_copy_area(conn, r->bar->buffer, r->bar->id, r->s->gc, 0, 0, 0, 0,
-	    WIDTH(r->bar) + 2 * bar_border_width,
-	    HEIGHT(r->bar) + 2 * bar_border_width);
+	xcb_copy_area(conn, bar->buffer, bar->id, bar->gc, 0, 0, 0, 0,
+	    WIDTH(bar) + 2 * bar_border_width,
+	    HEIGHT(bar) + 2 * bar_border_width);
 }
 
 static void
@@ -4064,126 +4552,772 @@ bar_extra_stop(void)
 		kill(bar_pid, SIGTERM);
 		bar_pid = 0;
 	}
+	if (bar_fd != -1) {
+		close(bar_fd);
+		bar_fd = -1;
+	}
+	bar_ext_len = 0;
 	strlcpy(bar_ext, "", sizeof bar_ext);
+	bar_segments_clear();
 	bar_extra = false;
 }
 
-static void
-bar_window_class(char *s, size_t sz, struct ws_win *win, size_t *n)
+/*
+ * Parse "{key}" at s into key (SWM_BAR_KEY_MAX bytes). Returns a pointer to
+ * the closing brace, or NULL if s is not a valid key reference.
+ */
+static char *
+bar_segment_key(char *s, char *key)
 {
-	if (win && win->ch.class_name)
-		bar_strlcat_esc(s, win->ch.class_name, sz, n);
-}
+	size_t			len;
+	char			*e;
 
-static void
-bar_window_instance(char *s, size_t sz, struct ws_win *win, size_t *n)
-{
-	if (win && win->ch.instance_name)
-		bar_strlcat_esc(s, win->ch.instance_name, sz, n);
-}
+	if (*s != '{' || (e = strchr(s, '}')) == NULL)
+		return (NULL);
 
-static void
-bar_window_class_instance(char *s, size_t sz, struct ws_win *win, size_t *n)
-{
-	if (win) {
-		bar_window_class(s, sz, win, n);
-		strlcat(s, ":", sz);
-		bar_window_instance(s, sz, win, n);
-	}
-}
+	len = e - s - 1;
+	if (len == 0 || len >= SWM_BAR_KEY_MAX)
+		return (NULL);
 
-static void
-bar_window_state(char *s, size_t sz, struct ws_win *win)
-{
-	if (win) {
-		if (MAXIMIZED(win))
-			strlcpy(s, focus_mark_maximized, sz);
-		else if (win_free(win))
-			strlcpy(s, focus_mark_free, sz);
-		else if (win_floating(win) && !FULLSCREEN(win))
-			strlcpy(s, focus_mark_floating, sz);
-		else
-			strlcpy(s, focus_mark_normal, sz);
-	} else
-		strlcpy(s, focus_mark_none, sz);
+	memcpy(key, s + 1, len);
+	key[len] = '\0';
+
+	return (e);
 }
 
-static void
-bar_window_name(char *s, size_t sz, struct ws_win *win, size_t *n)
+static const char *
+bar_segment_lookup(const char *key)
 {
-	char		*title;
+	struct bar_segment	*bs;
+	struct bar_source	*src;
 
-	if (win && win->mapped) {
-		title = get_win_name(win->id);
-		bar_strlcat_esc(s, title, sz, n);
-		free(title);
-	}
-}
+	if ((src = bar_source_find(key)) && src->value)
+		return (src->value);
 
-static void
-get_wm_normal_hints(struct ws_win *win)
-{
-	xcb_icccm_get_wm_normal_hints_reply(conn,
-	    xcb_icccm_get_wm_normal_hints(conn, win->id),
-	    &win->sh, NULL);
-}
+	SLIST_FOREACH(bs, &bar_segments, entry)
+		if (strcmp(bs->key, key) == 0)
+			return (bs->value);
 
-/* Get/refresh current WM_HINTS on a window. */
-static void
-get_wm_hints(struct ws_win *win)
-{
-	xcb_icccm_get_wm_hints_reply(conn,
-	    xcb_icccm_get_wm_hints(conn, win->id),
-	    &win->hints, NULL);
+	return ("");
 }
 
-/* Get/refresh WM_TRANSIENT_FOR on a window. */
+/*
+ * Store a "key=value" line, setting changed if the value differs. Returns
+ * false if the line is not keyed, leaving it to the caller.
+ */
 static bool
-get_wm_transient_for(struct ws_win *win)
+bar_segment_set(char *line, bool *changed)
 {
-	xcb_window_t		trans;
+	struct bar_segment	*bs;
+	char			*eq;
+	size_t			len;
 
-	DNPRINTF(SWM_D_MISC, "win %#x\n", WINID(win));
-	if (xcb_icccm_get_wm_transient_for_reply(conn,
-	    xcb_icccm_get_wm_transient_for(conn, win->id), &trans, NULL)) {
-		if (win->transient_for != trans) {
-			win->transient_for = trans;
-			win->parent = find_window(win->transient_for);
-			if (win->parent == win)
-				win->parent = NULL;
-			DNPRINTF(SWM_D_PROP, "transient_for: %#x, "
-			    "parent: %#x\n", trans, WINID(win->parent));
-			return (true);
-		}
-	}
+	if ((eq = strchr(line, '=')) == NULL)
+		return (false);
+	len = eq - line;
+	if (len == 0 || len >= SWM_BAR_KEY_MAX ||
+	    strcspn(line, "{}+ \t") < len)
+		return (false);
+	*eq++ = '\0';
 
-	return (false);
+	SLIST_FOREACH(bs, &bar_segments, entry)
+		if (strcmp(bs->key, line) == 0)
+			break;
+
+	if (bs == NULL) {
+		if ((bs = calloc(1, sizeof *bs)) == NULL)
+			err(1, "bar_segment_set: calloc");
+		strlcpy(bs->key, line, sizeof bs->key);
+		SLIST_INSERT_HEAD(&bar_segments, bs, entry);
+	} else if (strcmp(bs->value, eq) == 0)
+		return (true);
+
+	DNPRINTF(SWM_D_BAR, "%s: %s\n", bs->key, eq);
+
+	free(bs->value);
+	if ((bs->value = strdup(eq)) == NULL)
+		err(1, "bar_segment_set: strdup");
+	*changed = true;
+
+	return (true);
 }
 
 static void
-clear_attention(struct ws_win *win)
+bar_segments_clear(void)
 {
-	if (!DEMANDS_ATTENTION(win))
-		return;
+	struct bar_segment	*bs;
 
-	win->ewmh_flags &= ~EWMH_F_DEMANDS_ATTENTION;
-	ewmh_update_wm_state(win);
+	while ((bs = SLIST_FIRST(&bar_segments))) {
+		SLIST_REMOVE_HEAD(&bar_segments, entry);
+		free(bs->value);
+		free(bs);
+	}
 }
 
-static void
-set_attention(struct ws_win *win)
+static struct bar_source *
+bar_source_find(const char *name)
 {
-	if (DEMANDS_ATTENTION(win))
-		return;
+	struct bar_source	*bs;
 
-	win->ewmh_flags |= EWMH_F_DEMANDS_ATTENTION;
-	ewmh_update_wm_state(win);
+	TAILQ_FOREACH(bs, &bar_sources, entry)
+		if (strcmp(bs->name, name) == 0)
+			return (bs);
+
+	return (NULL);
 }
 
-static bool
-win_urgent(struct ws_win *win)
+static void
+bar_source_start(struct bar_source *bs)
 {
-	return (!(win->quirks & SWM_Q_IGNOREURGENT) &&
+	int			fd, p[2];
+
+	DNPRINTF(SWM_D_BAR, "%s: %s\n", bs->name, bs->cmd);
+
+	bs->next.tv_sec = bs->next.tv_nsec = 0;
+	clock_gettime(CLOCK_MONOTONIC, &bs->started);
+
+	if (pipe(p) == -1) {
+		warn("bar_source_start: pipe");
+		bs->next = bs->started;
+		bs->next.tv_sec += SWM_BAR_SOURCE_BACKOFF_MAX;
+		return;
+	}
+	/* Read must not block; other sources must not inherit it. */
+	socket_setnonblock(p[0]);
+	if (fcntl(p[0], F_SETFD, FD_CLOEXEC) == -1)
+		warn("bar_source_start: fcntl");
+
+	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+		err(1, "could not disable SIGPIPE");
+
+	switch (bs->pid = fork()) {
+	case -1:
+		err(1, "cannot fork");
+		break;
+	case 0: /* child */
+		close(p[0]);
+
+		/* Isolate stdin. */
+		if ((fd = open(_PATH_DEVNULL, O_RDONLY, 0)) == -1) {
+			warn("open /dev/null");
+			_exit(1);
+		}
+		if (dup2(fd, STDIN_FILENO) == -1) {
+			warn("dup2 stdin");
+			_exit(1);
+		}
+		if (fd > STDERR_FILENO)
+			close(fd);
+
+		if (dup2(p[1], STDOUT_FILENO) == -1) {
+			warn("dup2 stdout");
+			_exit(1);
+		}
+		if (p[1] > STDERR_FILENO)
+			close(p[1]);
+
+		execl(_PATH_BSHELL, _PATH_BSHELL, "-c", bs->cmd, (char *)NULL);
+		warn("%s: bar source failed", bs->name);
+		_exit(1);
+		break;
+	default: /* parent */
+		close(p[1]);
+		bs->fd = p[0];
+		bs->len = 0;
+		break;
+	}
+}
+
+static void
+bar_source_stop(struct bar_source *bs)
+{
+	sigset_t		set, oset;
+
+	/*
+	 * With SIGCHLD held off the handler cannot reap the child while we
+	 * look, so a pid that waitpid() reports as running is still ours.
+	 */
+	if (bs->pid) {
+		sigemptyset(&set);
+		sigaddset(&set, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &set, &oset);
+		if (waitpid(bs->pid, NULL, WNOHANG) == 0)
+			kill(bs->pid, SIGTERM);
+		sigprocmask(SIG_SETMASK, &oset, NULL);
+		bs->pid = 0;
+	}
+	if (bs->fd != -1) {
+		close(bs->fd);
+		bs->fd = -1;
+	}
+}
+
+static void
+bar_source_free(struct bar_source *bs)
+{
+	bar_source_stop(bs);
+	TAILQ_REMOVE(&bar_sources, bs, entry);
+	bar_source_count--;
+	free(bs->cmd);
+	free(bs->value);
+	free(bs);
+}
+
+static void
+bar_sources_clear(void)
+{
+	struct bar_source	*bs;
+
+	while ((bs = TAILQ_FIRST(&bar_sources)))
+		bar_source_free(bs);
+}
+
+/*
+ * Read pending output of a source, keeping only its last complete line.
+ * On EOF the source is scheduled to rerun after its interval, or after an
+ * exponential backoff if it is meant to be long-running.
+ */
+static bool
+bar_source_read(struct bar_source *bs)
+{
+	struct timespec		now;
+	char			*b, *nl;
+	ssize_t			n;
+	bool			changed = false;
+
+	while ((n = read(bs->fd, bs->buf + bs->len,
+	    sizeof bs->buf - bs->len - 1)) > 0) {
+		bs->len += n;
+		bs->buf[bs->len] = '\0';
+
+		/* Overlong lines are cut at the buffer size. */
+		if (bs->len == sizeof bs->buf - 1 &&
+		    strchr(bs->buf, '\n') == NULL)
+			bs->buf[bs->len - 1] = '\n';
+
+		b = NULL;
+		for (nl = bs->buf; (nl = strchr(nl, '\n')); nl++)
+			b = nl;
+		if (b == NULL)
+			continue;
+
+		/* Latest complete line wins; keep any partial tail. */
+		*b = '\0';
+		if ((nl = strrchr(bs->buf, '\n')) == NULL)
+			nl = bs->buf;
+		else
+			nl++;
+
+		if (bs->value == NULL || strcmp(bs->value, nl)) {
+			DNPRINTF(SWM_D_BAR, "%s: %s\n", bs->name, nl);
+			free(bs->value);
+			if ((bs->value = strdup(nl)) == NULL)
+				err(1, "bar_source_read: strdup");
+			changed = true;
+		}
+
+		bs->len -= b + 1 - bs->buf;
+		memmove(bs->buf, b + 1, bs->len + 1);
+	}
+
+	if (n == -1 && (errno == EAGAIN || errno == EINTR))
+		return (changed);
+	if (n == -1)
+		warn("%s: bar source read", bs->name);
+
+	/*
+	 * A command may close its output and keep running; stop it so only
+	 * one copy runs once rescheduled.  It is reaped by the SIGCHLD handler.
+	 */
+	bar_source_stop(bs);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec - bs->started.tv_sec >= SWM_BAR_SOURCE_STABLE)
+		bs->backoff = SWM_BAR_SOURCE_BACKOFF_MIN;
+
+	bs->next = now;
+	if (bs->interval > 0)
+		bs->next.tv_sec += bs->interval;
+	else {
+		bs->next.tv_sec += bs->backoff;
+		bs->backoff = MIN(bs->backoff * 2, SWM_BAR_SOURCE_BACKOFF_MAX);
+	}
+
+	DNPRINTF(SWM_D_BAR, "%s: exited, rerun in %llds\n", bs->name,
+	    (long long)(bs->next.tv_sec - now.tv_sec));
+
+	return (changed);
+}
+
+/* Start sources that are due; returns timeout capped to the next start. */
+static int
+bar_sources_schedule(int timeout)
+{
+	struct bar_source	*bs;
+	struct timespec		now;
+	long			ms;
+
+	if (TAILQ_EMPTY(&bar_sources))
+		return (timeout);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	TAILQ_FOREACH(bs, &bar_sources, entry) {
+		if (bs->fd != -1)
+			continue;
+
+		ms = (bs->next.tv_sec - now.tv_sec) * 1000 +
+		    (bs->next.tv_nsec - now.tv_nsec) / 1000000;
+		if (ms <= 0)
+			bar_source_start(bs);
+		else if (ms < timeout)
+			timeout = (int)ms;
+	}
+
+	return (timeout);
+}
+
+/* Fill one pollfd per source; returns the number filled. */
+static int
+bar_sources_pollfd(struct pollfd *pfd)
+{
+	struct bar_source	*bs;
+	int			n = 0;
+
+	TAILQ_FOREACH(bs, &bar_sources, entry) {
+		pfd[n].fd = bs->fd;
+		pfd[n].events = POLLIN;
+		pfd[n].revents = 0;
+		n++;
+	}
+
+	return (n);
+}
+
+static bool
+bar_sources_read(struct pollfd *pfd, int n)
+{
+	struct bar_source	*bs;
+	bool			changed = false;
+	int			i = 0;
+
+	TAILQ_FOREACH(bs, &bar_sources, entry) {
+		if (i >= n)
+			break;
+		if (bs->fd != -1 && pfd[i].fd == bs->fd &&
+		    pfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+			changed |= bar_source_read(bs);
+		i++;
+	}
+
+	return (changed);
+}
+
+/* Drop sources that are no longer configured after a config load. */
+static void
+bar_sources_update(void)
+{
+	struct bar_source	*bs, *nbs;
+	static bool		registered = false;
+
+	TAILQ_FOREACH_SAFE(bs, &bar_sources, entry, nbs)
+		if (!bs->configured || bs->cmd == NULL) {
+			DNPRINTF(SWM_D_BAR, "%s: removed\n", bs->name);
+			bar_source_free(bs);
+		}
+
+	if (!registered && !TAILQ_EMPTY(&bar_sources)) {
+		atexit(kill_bar_extra_atexit);
+		registered = true;
+	}
+}
+
+/* Open the first power supply of type Battery, via its uevent file. */
+static int
+bar_stat_battery_open(void)
+{
+	DIR			*d;
+	struct dirent		*de;
+	char			path[PATH_MAX], type[16];
+	ssize_t			n;
+	int			fd, tfd = -1;
+
+	if ((d = opendir(SWM_BAR_STAT_POWER)) == NULL)
+		return (-1);
+
+	fd = -1;
+	while (fd == -1 && (de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		snprintf(path, sizeof path, "%s/%s/type", SWM_BAR_STAT_POWER,
+		    de->d_name);
+		if ((tfd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+			continue;
+		n = read(tfd, type, sizeof type - 1);
+		close(tfd);
+		if (n <= 0 || strncmp(type, "Battery", 7))
+			continue;
+
+		snprintf(path, sizeof path, "%s/%s/uevent",
+		    SWM_BAR_STAT_POWER, de->d_name);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	closedir(d);
+
+	return (fd);
+}
+
+static bool
+bar_stat_open(int id)
+{
+	struct bar_stat		*st = &bar_stats[id];
+
+#ifdef __OpenBSD__
+	/* No procfs; opening files is also outside the pledge. */
+	(void)st;
+	return (false);
+#endif
+	if (st->fd != -1)
+		return (true);
+	if (st->failed)
+		return (false);
+
+	if (id == SWM_BAR_STAT_BATTERY)
+		st->fd = bar_stat_battery_open();
+	else
+		st->fd = open(st->path, O_RDONLY | O_CLOEXEC);
+
+	if (st->fd == -1) {
+		DNPRINTF(SWM_D_BAR, "stat %d unavailable\n", id);
+		st->failed = true;
+		return (false);
+	}
+
+	return (true);
+}
+
+static void
+bar_stat_close(void)
+{
+	int			i;
+
+	for (i = 0; i < SWM_BAR_STAT_MAX; i++) {
+		if (bar_stats[i].fd != -1)
+			close(bar_stats[i].fd);
+		bar_stats[i].fd = -1;
+		bar_stats[i].wanted = false;
+		bar_stats[i].failed = false;
+	}
+
+	free(bar_stat_buf);
+	bar_stat_buf = NULL;
+	bar_stat_bufsz = 0;
+}
+
+static void
+bar_stat_human(char *s, size_t sz, double v)
+{
+	const char		*unit = "KMGT";
+
+	if (v < 1024) {
+		snprintf(s, sz, "%.0fB", v);
+		return;
+	}
+	for (v /= 1024; v >= 1024 && unit[1]; v /= 1024)
+		unit++;
+	snprintf(s, sz, v < 10 ? "%.1f%c" : "%.0f%c", v, *unit);
+}
+
+/* Utilization across all CPUs since the previous sample. */
+static void
+bar_stat_cpu(struct bar_stat *st, char *buf)
+{
+	unsigned long long	v[8] = { 0 }, total = 0, idle, dt, di;
+	int			i;
+
+	if (sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0],
+	    &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4)
+		return;
+
+	for (i = 0; i < 8; i++)
+		total += v[i];
+	idle = v[3] + v[4];
+
+	dt = total - st->prev[0];
+	di = idle - st->prev[1];
+	st->prev[0] = total;
+	st->prev[1] = idle;
+
+	if (dt > 0)
+		snprintf(st->value, sizeof st->value, "%d%%",
+		    (int)((dt - MIN(di, dt)) * 100 / dt));
+}
+
+static void
+bar_stat_mem(struct bar_stat *st, char *buf)
+{
+	unsigned long long	total = 0, avail = 0;
+	char			*p;
+
+	if ((p = strstr(buf, "MemTotal:")))
+		sscanf(p + 9, "%llu", &total);
+	if ((p = strstr(buf, "MemAvailable:")))
+		sscanf(p + 13, "%llu", &avail);
+
+	if (total > 0)
+		snprintf(st->value, sizeof st->value, "%d%%",
+		    (int)((total - MIN(avail, total)) * 100 / total));
+}
+
+static void
+bar_stat_battery(struct bar_stat *st, char *buf)
+{
+	int			cap = -1;
+	char			*p;
+	bool			charging;
+
+	if ((p = strstr(buf, "POWER_SUPPLY_CAPACITY=")))
+		cap = atoi(p + 22);
+	charging = strstr(buf, "POWER_SUPPLY_STATUS=Charging") != NULL;
+
+	if (cap >= 0)
+		snprintf(st->value, sizeof st->value, "%d%%%s", cap,
+		    charging ? "+" : "");
+}
+
+/* Receive/transmit rate summed over all interfaces except loopback. */
+static void
+bar_stat_net(struct bar_stat *st, char *buf, double elapsed)
+{
+	unsigned long long	rx, tx, rxsum = 0, txsum = 0;
+	char			*line, *p, rxs[16], txs[16];
+	bool			first;
+
+	first = (st->prev[0] == 0 && st->prev[1] == 0);
+
+	/* Skip the two header lines. */
+	for (line = buf; (line = strchr(line, '\n')); ) {
+		line++;
+		if ((p = strchr(line, ':')) == NULL)
+			continue;
+		if (strncmp(line + strspn(line, " "), "lo:", 3) == 0)
+			continue;
+		if (sscanf(p + 1, "%llu %*s %*s %*s %*s %*s %*s %*s %llu",
+		    &rx, &tx) == 2) {
+			rxsum += rx;
+			txsum += tx;
+		}
+	}
+
+	if (!first && elapsed > 0 && rxsum >= st->prev[0] &&
+	    txsum >= st->prev[1]) {
+		bar_stat_human(rxs, sizeof rxs, (rxsum - st->prev[0]) / elapsed);
+		bar_stat_human(txs, sizeof txs, (txsum - st->prev[1]) / elapsed);
+		snprintf(st->value, sizeof st->value, "%s/%s", rxs, txs);
+	}
+	st->prev[0] = rxsum;
+	st->prev[1] = txsum;
+}
+
+/* Refresh a provider; its file stays open between samples. */
+static void
+bar_stat_sample(int id, double elapsed)
+{
+	struct bar_stat		*st = &bar_stats[id];
+	char			*buf;
+	size_t			len = 0;
+	ssize_t			n;
+
+	if (!bar_stat_open(id))
+		return;
+
+	/* Read to EOF; /proc/net/dev grows with the number of interfaces. */
+	for (;;) {
+		if (bar_stat_bufsz - len < 2) {
+			bar_stat_bufsz = (bar_stat_bufsz ? bar_stat_bufsz * 2 :
+			    SWM_BAR_STAT_BUFSZ);
+			if ((bar_stat_buf = realloc(bar_stat_buf,
+			    bar_stat_bufsz)) == NULL)
+				err(1, "bar_stat_sample: realloc");
+		}
+
+		n = pread(st->fd, bar_stat_buf + len, bar_stat_bufsz - len - 1,
+		    len);
+		if (n == 0)
+			break;
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			warn("bar_stat_sample: pread");
+			close(st->fd);
+			st->fd = -1;
+			return;
+		}
+		len += n;
+	}
+	buf = bar_stat_buf;
+	buf[len] = '\0';
+
+	switch (id) {
+	case SWM_BAR_STAT_BATTERY:
+		bar_stat_battery(st, buf);
+		break;
+	case SWM_BAR_STAT_CPU:
+		bar_stat_cpu(st, buf);
+		break;
+	case SWM_BAR_STAT_LOAD:
+		snprintf(st->value, sizeof st->value, "%.*s",
+		    (int)strcspn(buf, " "), buf);
+		break;
+	case SWM_BAR_STAT_MEM:
+		bar_stat_mem(st, buf);
+		break;
+	case SWM_BAR_STAT_NET:
+		bar_stat_net(st, buf, elapsed);
+		break;
+	}
+}
+
+/* Current value of a provider, sampling at most every interval. */
+static const char *
+bar_stat_value(int id)
+{
+	struct bar_stat		*st = &bar_stats[id];
+	struct timespec		now;
+	double			elapsed;
+
+	/* Each provider keeps its own clock so rates span a full interval. */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - st->last.tv_sec) +
+	    (now.tv_nsec - st->last.tv_nsec) / 1e9;
+	if (!st->wanted || elapsed >= SWM_BAR_STAT_INTERVAL) {
+		st->wanted = true;
+		st->last = now;
+		bar_stat_sample(id, elapsed);
+	}
+
+	return (st->value);
+}
+
+static void
+bar_window_class(char *s, size_t sz, struct ws_win *win, size_t *n)
+{
+	if (win && win->ch.class_name)
+		bar_strlcat_esc(s, win->ch.class_name, sz, n);
+}
+
+static void
+bar_window_instance(char *s, size_t sz, struct ws_win *win, size_t *n)
+{
+	if (win && win->ch.instance_name)
+		bar_strlcat_esc(s, win->ch.instance_name, sz, n);
+}
+
+static void
+bar_window_class_instance(char *s, size_t sz, struct ws_win *win, size_t *n)
+{
+	if (win) {
+		bar_window_class(s, sz, win, n);
+		strlcat(s, ":", sz);
+		bar_window_instance(s, sz, win, n);
+	}
+}
+
+static void
+bar_window_state(char *s, size_t sz, struct ws_win *win)
+{
+	if (win) {
+		if (MAXIMIZED(win))
+			strlcpy(s, focus_mark_maximized, sz);
+		else if (win_free(win))
+			strlcpy(s, focus_mark_free, sz);
+		else if (win_floating(win) && !FULLSCREEN(win))
+			strlcpy(s, focus_mark_floating, sz);
+		else
+			strlcpy(s, focus_mark_normal, sz);
+	} else
+		strlcpy(s, focus_mark_none, sz);
+}
+
+static void
+bar_window_name(char *s, size_t sz, struct ws_win *win, size_t *n)
+{
+	char		*title;
+
+	if (win && win->mapped) {
+		title = get_win_name(win->id);
+		bar_strlcat_esc(s, title, sz, n);
+		free(title);
+	}
+}
+
+static void
+get_wm_normal_hints(struct ws_win *win)
+{
+	xcb_icccm_get_wm_normal_hints_reply(conn,
+	    xcb_icccm_get_wm_normal_hints(conn, win->id),
+	    &win->sh, NULL);
+}
+
+/* Get/refresh current WM_HINTS on a window. */
+static void
+get_wm_hints(struct ws_win *win)
+{
+	xcb_icccm_get_wm_hints_reply(conn,
+	    xcb_icccm_get_wm_hints(conn, win->id),
+	    &win->hints, NULL);
+	win_count_update(win);
+}
+
+/* Get/refresh WM_TRANSIENT_FOR on a window. */
+static bool
+get_wm_transient_for(struct ws_win *win)
+{
+	xcb_window_t		trans;
+
+	DNPRINTF(SWM_D_MISC, "win %#x\n", WINID(win));
+	if (xcb_icccm_get_wm_transient_for_reply(conn,
+	    xcb_icccm_get_wm_transient_for(conn, win->id), &trans, NULL)) {
+		if (win->transient_for != trans) {
+			win->transient_for = trans;
+			win_set_parent(win, find_window(win->transient_for));
+			if (win->parent == win)
+				win_set_parent(win, NULL);
+			DNPRINTF(SWM_D_PROP, "transient_for: %#x, "
+			    "parent: %#x\n", trans, WINID(win->parent));
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+static void
+clear_attention(struct ws_win *win)
+{
+	if (!DEMANDS_ATTENTION(win))
+		return;
+
+	win->ewmh_flags &= ~EWMH_F_DEMANDS_ATTENTION;
+	win_count_update(win);
+	ewmh_update_wm_state(win);
+}
+
+static void
+set_attention(struct ws_win *win)
+{
+	if (DEMANDS_ATTENTION(win))
+		return;
+
+	win->ewmh_flags |= EWMH_F_DEMANDS_ATTENTION;
+	win_count_update(win);
+	ewmh_update_wm_state(win);
+}
+
+static bool
+win_urgent(struct ws_win *win)
+{
+	return (!(win->quirks & SWM_Q_IGNOREURGENT) &&
 	    (xcb_icccm_wm_hints_get_urgency(&win->hints) != 0 ||
 	    DEMANDS_ATTENTION(win)));
 }
@@ -4192,7 +5326,6 @@ static void
 bar_urgent(struct swm_screen *s, char *str, size_t sz)
 {
 	struct workspace	*ws;
-	struct ws_win		*win;
 	int			i;
 	bool			urgent;
 	char			b[13];
@@ -4205,14 +5338,7 @@ bar_urgent(struct swm_screen *s, char *str, size_t sz)
 		while (ws && ws->idx < i)
 			ws = RB_NEXT(workspace_tree, &s->workspaces, ws);
 
-		urgent = false;
-		if (ws && ws->idx == i) {
-			TAILQ_FOREACH(win, &ws->winlist, entry)
-				if (win_urgent(win)) {
-					urgent = true;
-					break;
-				}
-		}
+		urgent = (ws && ws->idx == i && ws->urgent_count > 0);
 
 		if (urgent) {
 			snprintf(b, sizeof b, "%d ", i + 1);
@@ -4227,7 +5353,6 @@ bar_urgent(struct swm_screen *s, char *str, size_t sz)
 static void
 bar_workspace_indicator(char *s, size_t sz, struct swm_region *r)
 {
-	struct ws_win		*w;
 	struct workspace	*ws;
 	int		 	 count = 0, i;
 	char			 tmp[SWM_BAR_MAX], *mark, *suffix, *name;
@@ -4250,13 +5375,7 @@ bar_workspace_indicator(char *s, size_t sz, struct swm_region *r)
 			current = (ws == r->ws);
 			active = (TAILQ_FIRST(&ws->winlist) != NULL);
 			name = ws->name;
-
-			/* Get urgency status if needed. */
-			if (workspace_indicator & SWM_WSI_LISTURGENT ||
-			    workspace_indicator & SWM_WSI_MARKURGENT)
-				TAILQ_FOREACH(w, &ws->winlist, entry)
-					if ((urgent = win_urgent(w)))
-						break;
+			urgent = (ws->urgent_count > 0);
 		} else {
 			current = false;
 			active = false;
@@ -4410,8 +5529,9 @@ bar_replace_seq(char *fmt, char *fmtrep, struct swm_region *r, size_t *offrep,
     size_t sz)
 {
 	struct ws_win		*w, *cfw;
-	char			*ptr, *cur = fmt;
-	char			tmp[SWM_BAR_MAX];
+	char			*ptr, *cur = fmt, *e;
+	char			tmp[SWM_BAR_MAX], key[SWM_BAR_KEY_MAX];
+	const char		*ext;
 	int			size, num;
 	size_t			len, limit;
 	int			pre_padding = 0;
@@ -4458,11 +5578,34 @@ bar_replace_seq(char *fmt, char *fmtrep, struct swm_region *r, size_t *offrep,
 	case '<':
 		bar_replace_pad(tmp, &limit, sizeof tmp);
 		break;
+	case 'b':
+		snprintf(tmp, sizeof tmp, "%s",
+		    bar_stat_value(SWM_BAR_STAT_BATTERY));
+		break;
+	case 'c':
+		snprintf(tmp, sizeof tmp, "%s", bar_stat_value(SWM_BAR_STAT_CPU));
+		break;
+	case 'l':
+		snprintf(tmp, sizeof tmp, "%s",
+		    bar_stat_value(SWM_BAR_STAT_LOAD));
+		break;
+	case 'm':
+		snprintf(tmp, sizeof tmp, "%s", bar_stat_value(SWM_BAR_STAT_MEM));
+		break;
+	case 'n':
+		snprintf(tmp, sizeof tmp, "%s", bar_stat_value(SWM_BAR_STAT_NET));
+		break;
 	case 'A':
+		ext = bar_ext;
+		if ((e = bar_segment_key(cur + 1, key))) {
+			/* Keyed segment; consume up to the closing brace. */
+			ext = bar_segment_lookup(key);
+			cur = e;
+		}
 		if (bar_action_expand)
-			snprintf(tmp, sizeof tmp, "%s", bar_ext);
+			snprintf(tmp, sizeof tmp, "%s", ext);
 		else
-			bar_strlcat_esc(tmp, bar_ext, sizeof tmp, &limit);
+			bar_strlcat_esc(tmp, (char *)ext, sizeof tmp, &limit);
 		break;
 	case 'C':
 		bar_window_class(tmp, sizeof tmp, cfw, &limit);
@@ -4629,7 +5772,7 @@ static void
 bar_replace(char *fmt, char *fmtrep, struct swm_region *r, size_t sz)
 {
 	size_t		off;
-	char		*s;
+	char		*s, key[SWM_BAR_KEY_MAX];
 
 	off = 0;
 	while (*fmt != '\0') {
@@ -4648,7 +5791,9 @@ bar_replace(char *fmt, char *fmtrep, struct swm_region *r, size_t sz)
 
 		if ((bar_action_expand) && (*s == 'A')) {
 			/* skip this character sequence */
-			fmt = s + 1;
+			if ((fmt = bar_segment_key(s + 1, key)) == NULL)
+				fmt = s;
+			fmt++;
 			continue;
 		}
 
@@ -4796,30 +5941,34 @@ scan_markup(struct swm_screen *s, char *f, int *n, size_t *size)
 static int
 get_character_font(struct swm_screen *s, FcChar32 c, int pref)
 {
+	XftFont			*xf;
 	int			i;
 
 	if (bar_font_legacy)
 		return (0);
 
+	/* Fallback fonts are only opened once a character needs them. */
+
 	/* Try special font for PUA codepoints. */
-	if (font_pua_index && s->bar_xftfonts[font_pua_index] &&
+	if (font_pua_index &&
 	    ((0xe000 <= c && c <= 0xf8ff) || (0xf0000 <= c && c <= 0xffffd) ||
 	    (0x100000 <= c && c <= 0x10fffd)) &&
-	    XftCharExists(display, s->bar_xftfonts[font_pua_index], c))
+	    (xf = xft_font(s, font_pua_index)) &&
+	    XftCharExists(display, xf, c))
 		return (font_pua_index);
 
 	if (pref >= num_xftfonts)
 		pref = -1;
 
 	/* Try specified font. */
-	if (pref >= 0 && s->bar_xftfonts[pref] &&
-	    XftCharExists(display, s->bar_xftfonts[pref], c))
+	if (pref >= 0 && (xf = xft_font(s, pref)) &&
+	    XftCharExists(display, xf, c))
 		return (pref);
 
 	/* Search the rest, from the top. */
 	for (i = 0; i < num_xftfonts; i++)
-		if (i != pref && s->bar_xftfonts[i] &&
-		    XftCharExists(display, s->bar_xftfonts[i], c))
+		if (i != pref && (xf = xft_font(s, i)) &&
+		    XftCharExists(display, xf, c))
 			return (i);
 
 	/* Fallback to the specified font, if valid. */
@@ -4988,20 +6137,51 @@ update_bars(struct swm_screen *s)
 		bar_draw(r->bar);
 }
 
+/* Queue a bar for rendering once pending events have been handled. */
 static void
 bar_draw(struct swm_bar *bar)
+{
+	if (bar == NULL)
+		return;
+
+	bar->dirty = true;
+	bars_dirty = true;
+}
+
+/* Render all queued bars. */
+static void
+bar_flush(void)
+{
+	struct swm_region	*r;
+	int			i, num_screens;
+
+	if (!bars_dirty)
+		return;
+	bars_dirty = false;
+
+	num_screens = get_screen_count();
+	for (i = 0; i < num_screens; i++)
+		TAILQ_FOREACH(r, &screens[i].rl, entry)
+			if (r->bar && r->bar->dirty)
+				bar_render(r->bar);
+}
+
+static void
+bar_render(struct swm_bar *bar)
 {
 	struct swm_region	*r;
 	char			fmtexp[SWM_BAR_MAX], fmtnew[SWM_BAR_MAX];
 	char			fmtact[SWM_BAR_MAX * 2];
+	struct swm_bar_colors	*bc;
+	size_t			len, off, n;
 	int			i;
+	bool			same;
+
+	bar->dirty = false;
 
 	/* expand the format by first passing it through strftime(3) */
 	bar_fmt_expand(fmtexp, sizeof fmtexp);
 
-	if (bar == NULL)
-		return;
-
 	r = bar->r;
 
 	if (!bar_enabled || !r->ws->bar_enabled || r->bar->disabled) {
@@ -5019,6 +6199,8 @@ bar_draw(struct swm_bar *bar)
 			bar_print_legacy(r, fmtexp);
 		else
 			bar_print(r, fmtexp);
+		bar->drawn = true;
+		bar->last_len = 0;
 		return;
 	}
 
@@ -5033,7 +6215,40 @@ bar_draw(struct swm_bar *bar)
 		bar_replace(bsect[i].fmtsplit, bsect[i].fmtrep, r,
 		    sizeof bsect[i].fmtrep);
 
+	/* Skip drawing if neither the text nor its colors changed. */
+	len = 0;
+	for (i = 0; i < numsect; i++)
+		len += strlen(bsect[i].fmtrep) + 1;
+	bc = bar_colors(r);
+	same = (bar->drawn && bar->last_len == len &&
+	    bar->last_fg == bc->fg_type && bar->last_bg == bc->bg_type &&
+	    bar->last_gen == bc->gen && bar->last_width == WIDTH(bar));
+	for (i = 0, off = 0; same && i < numsect; i++) {
+		n = strlen(bsect[i].fmtrep) + 1;
+		same = (memcmp(bar->last_text + off, bsect[i].fmtrep, n) == 0);
+		off += n;
+	}
+	if (same) {
+		DNPRINTF(SWM_D_BAR, "unchanged\n");
+		return;
+	}
+
 	bar_print_layout(r);
+	bar->drawn = true;
+
+	if (len > bar->last_len &&
+	    (bar->last_text = realloc(bar->last_text, len)) == NULL)
+		err(1, "bar_render: realloc");
+	for (i = 0, off = 0; i < numsect; i++) {
+		n = strlen(bsect[i].fmtrep) + 1;
+		memcpy(bar->last_text + off, bsect[i].fmtrep, n);
+		off += n;
+	}
+	bar->last_len = len;
+	bar->last_fg = bc->fg_type;
+	bar->last_bg = bc->bg_type;
+	bar->last_gen = bc->gen;
+	bar->last_width = WIDTH(bar);
 }
 
 /*
@@ -5043,39 +6258,71 @@ bar_draw(struct swm_bar *bar)
 static int
 bar_extra_update(void)
 {
-	size_t		len;
-	char		b[SWM_BAR_MAX];
+	char		*b, *e, *line, *last;
+	ssize_t		n;
 	bool		changed = false;
 
-	if (!bar_extra)
+	if (!bar_extra || bar_fd == -1)
 		return (changed);
 
-	while (fgets(b, sizeof(b), stdin) != NULL) {
-		if (bar_enabled) {
-			len = strlen(b);
-			if (len > 0 && b[len - 1] == '\n') {
-				/* Remove newline. */
-				b[--len] = '\0';
-
-				/* "Clear" bar_ext. */
-				bar_ext[0] = '\0';
-
-				/* Flush buffered output. */
-				strlcpy(bar_ext, bar_ext_buf, sizeof(bar_ext));
-				bar_ext_buf[0] = '\0';
+	/*
+	 * Drain the pipe into bar_ext_buf, which carries any partial line
+	 * over from the previous read. Only the last complete line of each
+	 * read is published, unless keyed lines have to be applied in turn.
+	 */
+	while ((n = read(bar_fd, bar_ext_buf + bar_ext_len,
+	    sizeof bar_ext_buf - bar_ext_len - 1)) > 0) {
+		bar_ext_len += n;
+		bar_ext_buf[bar_ext_len] = '\0';
+
+		/* Scan back to the end of the last complete line. */
+		e = bar_ext_buf + bar_ext_len;
+		while (e > bar_ext_buf && e[-1] != '\n')
+			e--;
+		if (e == bar_ext_buf) {
+			if (bar_ext_len < sizeof bar_ext_buf - 1)
+				continue;
+			/* Overlong line; cut it at the buffer size. */
+			e = bar_ext_buf + bar_ext_len;
+		}
+		e[-1] = '\0';
 
-				/* Append new output to bar. */
-				strlcat(bar_ext, b, sizeof(bar_ext));
+		if (bar_enabled) {
+			last = NULL;
+			if (bar_action_keyed) {
+				/* Keyed segments only update their entry. */
+				for (b = bar_ext_buf; b < e; b = line) {
+					if ((line = strchr(b, '\n')))
+						*line++ = '\0';
+					else
+						line = e;
+					if (!bar_segment_set(b, &changed))
+						last = b;
+				}
+			} else {
+				for (last = e - 1; last > bar_ext_buf &&
+				    last[-1] != '\n'; last--)
+					;
+			}
 
+			if (last && strcmp(bar_ext, last)) {
+				strlcpy(bar_ext, last, sizeof bar_ext);
 				changed = true;
-			} else {
-				/* Buffer output. */
-				strlcat(bar_ext_buf, b, sizeof(bar_ext_buf));
 			}
 		}
+
+		/* Keep the partial tail for the next read. */
+		bar_ext_len -= e - bar_ext_buf;
+		memmove(bar_ext_buf, e, bar_ext_len + 1);
 	}
 
-	if (errno != EAGAIN) {
+	if (n == 0) {
+		/* Keep the last output once the script exits. */
+		DNPRINTF(SWM_D_BAR, "bar_action exited\n");
+		close(bar_fd);
+		bar_fd = -1;
+		bar_extra = false;
+	} else if (errno != EAGAIN && errno != EINTR) {
 		warn("bar_action failed");
 		bar_extra_stop();
 		changed = true;
@@ -5181,23 +6428,31 @@ bar_extra_setup(void)
 		default: /* parent */
 			close(bar_pipe[1]);
 
-			/* Reassign stdin to read end of pipe. */
-			if (dup2(bar_pipe[0], STDIN_FILENO) == -1)
-				err(1, "dup2");
-			if (bar_pipe[0] > STDERR_FILENO)
-				close(bar_pipe[0]);
+			/* Keep the read end out of other children. */
+			if (fcntl(bar_pipe[0], F_SETFD, FD_CLOEXEC) == -1)
+				warn("bar_extra_setup: fcntl");
+			bar_fd = bar_pipe[0];
+			bar_ext_len = 0;
 			break;
 		}
 
 		atexit(kill_bar_extra_atexit);
 	}
+
+	bar_sources_update();
 }
 
 static void
 kill_bar_extra_atexit(void)
 {
+	struct bar_source	*bs;
+
 	if (bar_pid)
 		kill(bar_pid, SIGTERM);
+
+	TAILQ_FOREACH(bs, &bar_sources, entry)
+		if (bs->pid)
+			kill(bs->pid, SIGTERM);
 }
 
 bool
@@ -5264,30 +6519,119 @@ fontset_init(void)
 	return (0);
 }
 
+/* Fonts match on a screen when its depth, visual and resolution are equal. */
+static bool
+xft_screen_match(int a, int b)
+{
+	if (a == b)
+		return (true);
+
+	return (DefaultDepth(display, a) == DefaultDepth(display, b) &&
+	    DefaultVisual(display, a)->class ==
+	    DefaultVisual(display, b)->class &&
+	    DisplayWidth(display, a) * DisplayWidthMM(display, b) ==
+	    DisplayWidth(display, b) * DisplayWidthMM(display, a) &&
+	    DisplayHeight(display, a) * DisplayHeightMM(display, b) ==
+	    DisplayHeight(display, b) * DisplayHeightMM(display, a));
+}
+
+/* Reference a cached font, opening it when allowed and not yet cached. */
+static struct swm_xftfont *
+xft_font_get(struct swm_screen *s, const char *name, bool open)
+{
+	struct swm_xftfont	*f;
+
+	TAILQ_FOREACH(f, &xftfonts, entry)
+		if (strcmp(f->name, name) == 0 &&
+		    xft_screen_match(s->idx, f->screen)) {
+			f->refs++;
+			return (f);
+		}
+
+	if (!open)
+		return (NULL);
+
+	DNPRINTF(SWM_D_INIT, "screen %d: %s\n", s->idx, name);
+
+	if ((f = calloc(1, sizeof *f)) == NULL)
+		err(1, "xft_font_get: calloc");
+	if ((f->name = strdup(name)) == NULL)
+		err(1, "xft_font_get: strdup");
+
+	f->screen = s->idx;
+	f->font = XftFontOpenName(display, s->idx, name);
+	if (f->font == NULL)
+		warnx("unable to load font %s", name);
+	f->refs = 1;
+	TAILQ_INSERT_TAIL(&xftfonts, f, entry);
+
+	return (f);
+}
+
+/* Get font i on s, opening it on first use. */
+static XftFont *
+xft_font(struct swm_screen *s, int i)
+{
+	const char		*name;
+
+	if (s->bar_xftref == NULL)
+		return (NULL);
+
+	if (s->bar_xftref[i] == NULL) {
+		name = (i == num_xftfonts ? bar_fontname_pua :
+		    bar_fontnames[i]);
+		if (name == NULL)
+			return (NULL);
+		s->bar_xftref[i] = xft_font_get(s, name, true);
+		s->bar_xftfonts[i] = s->bar_xftref[i]->font;
+	}
+
+	return (s->bar_xftfonts[i]);
+}
+
+/* Close fonts no longer referenced by any screen. */
+static void
+xft_fonts_prune(void)
+{
+	struct swm_xftfont	*f, *nf;
+
+	TAILQ_FOREACH_SAFE(f, &xftfonts, entry, nf) {
+		if (f->refs > 0)
+			continue;
+
+		DNPRINTF(SWM_D_INIT, "close %s\n", f->name);
+		TAILQ_REMOVE(&xftfonts, f, entry);
+		if (f->font)
+			XftFontClose(display, f->font);
+		free(f->name);
+		free(f);
+	}
+}
+
+/* Drop the screen's font references; unused fonts close on prune. */
 static void
 xft_free(struct swm_screen *s)
 {
 	int		i;
 
-	if (s->bar_xftfonts == NULL)
+	if (s->bar_xftref == NULL)
 		return;
 
-	for (i = 0; i < num_xftfonts; i++)
-		if (s->bar_xftfonts[i])
-			XftFontClose(display, s->bar_xftfonts[i]);
-
-	if (font_pua_index)
-		XftFontClose(display, s->bar_xftfonts[font_pua_index]);
+	for (i = 0; i <= num_xftfonts; i++)
+		if (s->bar_xftref[i])
+			s->bar_xftref[i]->refs--;
 
+	free(s->bar_xftref);
 	free(s->bar_xftfonts);
+	s->bar_xftref = NULL;
 	s->bar_xftfonts = NULL;
+	s->sd.font = NULL;
 }
 
 static int
 xft_init(struct swm_screen *s)
 {
-	struct swm_color	*c;
-	XRenderColor		color;
+	const char		*name;
 	int			i;
 
 	DNPRINTF(SWM_D_INIT, "loading bar_fonts: %s\n", bar_fonts);
@@ -5298,23 +6642,47 @@ xft_init(struct swm_screen *s)
 	if ((s->bar_xftfonts = calloc(num_xftfonts + 1,
 	    sizeof(XftFont *))) == NULL)
 		err(1, "xft_init: calloc");
+	if ((s->bar_xftref = calloc(num_xftfonts + 1,
+	    sizeof(struct swm_xftfont *))) == NULL)
+		err(1, "xft_init: calloc");
 
-	for (i = 0; i < num_xftfonts; i++) {
-		s->bar_xftfonts[i] = XftFontOpenName(display, s->idx,
+	/*
+	 * Only the primary font is opened now; fallbacks are left for
+	 * get_character_font(), except those already open from before.
+	 */
+	for (i = 0; i <= num_xftfonts; i++) {
+		name = (i == num_xftfonts ? bar_fontname_pua :
 		    bar_fontnames[i]);
-		if (s->bar_xftfonts[i] == NULL)
-			warnx("unable to load font %s", bar_fontnames[i]);
+		if (name == NULL)
+			continue;
+		s->bar_xftref[i] = xft_font_get(s, name, i == 0);
+		if (s->bar_xftref[i])
+			s->bar_xftfonts[i] = s->bar_xftref[i]->font;
 	}
 
-	font_pua_index = 0;
-	if (bar_fontname_pua) {
-		s->bar_xftfonts[num_xftfonts] = XftFontOpenName(display, s->idx,
-		    bar_fontname_pua);
-		if (s->bar_xftfonts[num_xftfonts] == NULL)
-			warnx("unable to load font %s", bar_fontname_pua);
-		else
-			font_pua_index = num_xftfonts;
-	}
+	font_pua_index = (bar_fontname_pua ? num_xftfonts : 0);
+
+	xft_init_colors(s);
+
+	if (s->bar_xftfonts[0] == NULL)
+		return (1);
+
+	bar_height = s->bar_xftfonts[0]->height +
+	    2 * (bar_border_width + bar_padding_vertical);
+	if (bar_height < 1)
+		bar_height = 1;
+
+	return (0);
+}
+
+static void
+xft_init_colors(struct swm_screen *s)
+{
+	struct swm_color	*c;
+	XRenderColor		color;
+	int			i;
+
+	color_gen++;
 
 	for (i = 0; i < s->c[SWM_S_COLOR_BAR_FONT].count; i++) {
 		c = s->c[SWM_S_COLOR_BAR_FONT].colors[i];
@@ -5347,16 +6715,6 @@ xft_init(struct swm_screen *s)
 		    &color, &c->xft_color))
 			warnx("Xft error: unable to allocate color.");
 	}
-
-	if (s->bar_xftfonts[0] == NULL)
-		return (1);
-
-	bar_height = s->bar_xftfonts[0]->height +
-	    2 * (bar_border_width + bar_padding_vertical);
-	if (bar_height < 1)
-		bar_height = 1;
-
-	return (0);
 }
 
 static void
@@ -5452,6 +6810,20 @@ setup_fonts(void)
 		if (fontset_init())
 			errx(1, "Failed to load a font.");
 	}
+
+	/* Close fonts left over from before a reload. */
+	xft_fonts_prune();
+}
+
+/* Place the bar within its region. */
+static void
+bar_set_geometry(struct swm_region *r)
+{
+	X(r->bar) = X(r) + bar_border_width;
+	Y(r->bar) = bar_at_bottom ? (Y(r) + HEIGHT(r) - bar_height +
+	    bar_border_width) : Y(r) + bar_border_width;
+	WIDTH(r->bar) = WIDTH(r) - 2 * bar_border_width;
+	HEIGHT(r->bar) = bar_height - 2 * bar_border_width;
 }
 
 static void
@@ -5482,11 +6854,7 @@ bar_setup(struct swm_region *r)
 	r->bar->st->s = s;
 
 	r->bar->r = r;
-	X(r->bar) = X(r) + bar_border_width;
-	Y(r->bar) = bar_at_bottom ? (Y(r) + HEIGHT(r) - bar_height +
-	    bar_border_width) : Y(r) + bar_border_width;
-	WIDTH(r->bar) = WIDTH(r) - 2 * bar_border_width;
-	HEIGHT(r->bar) = bar_height - 2 * bar_border_width;
+	bar_set_geometry(r);
 	r->bar->disabled = false;
 
 	/* Assume region is unfocused when we create the bar. */
@@ -5541,6 +6909,12 @@ bar_setup(struct swm_region *r)
 	    WIDTH(r->bar) + 2 * bar_border_width,
 	    HEIGHT(r->bar) + 2 * bar_border_width);
 
+	/* Foreground and line width start at the server defaults of 0. */
+	r->bar->gc = xcb_generate_id(conn);
+	wa[0] = 0;
+	xcb_create_gc(conn, r->bar->gc, r->bar->buffer,
+	    XCB_GC_GRAPHICS_EXPOSURES, wa);
+
 	if (bar_enabled)
 		xcb_map_window(conn, r->bar->id);
 
@@ -5569,8 +6943,17 @@ bar_cleanup(struct swm_region *r)
 	if (r->bar == NULL)
 		return;
 
+	if (r->bar->xft_draw)
+		XftDrawDestroy(r->bar->xft_draw);
+	if (r->bar->legacy_gc)
+		XFreeGC(display, r->bar->legacy_gc);
+	xcb_free_gc(conn, r->bar->gc);
 	xcb_destroy_window(conn, r->bar->id);
 	xcb_free_pixmap(conn, r->bar->buffer);
+	free(r->bar->colors.fg_pixel);
+	free(r->bar->colors.fg_xft);
+	free(r->bar->colors.bg_pixel);
+	free(r->bar->last_text);
 	free_stackable(r->bar->st);
 	free(r->bar);
 	r->bar = NULL;
@@ -5786,11 +7169,82 @@ config_win(struct ws_win *win, xcb_configure_request_event_t *ev)
 	    (char *)&ce);
 }
 
+static uint8_t
+win_count_state(struct ws_win *win)
+{
+	uint8_t			state = 0;
+
+	if (HIDDEN(win))
+		state |= SWM_WCOUNT_HIDDEN;
+	if (WINDESKTOP(win))
+		state |= SWM_WCOUNT_DESKTOP;
+	if (win_urgent(win))
+		state |= SWM_WCOUNT_URGENT;
+
+	return (state);
+}
+
+static void
+win_count_remove(struct ws_win *win)
+{
+	struct workspace	*ws = win->count_ws;
+
+	if (ws == NULL)
+		return;
+
+	ws->win_count[win->count_state & (SWM_WCOUNT_CLASSES - 1)]--;
+	if (win->count_state & SWM_WCOUNT_URGENT)
+		ws->urgent_count--;
+
+	win->count_ws = NULL;
+	win->count_state = 0;
+}
+
+/* Sync the counters of the workspace holding win with its current state. */
+static void
+win_count_update(struct ws_win *win)
+{
+	struct workspace	*ws = win->ws;
+	uint8_t			state;
+
+	if (ws == NULL) {
+		win_count_remove(win);
+		return;
+	}
+
+	state = win_count_state(win);
+	if (win->count_ws == ws && win->count_state == state)
+		return;
+
+	win_count_remove(win);
+
+	ws->win_count[state & (SWM_WCOUNT_CLASSES - 1)]++;
+	if (state & SWM_WCOUNT_URGENT)
+		ws->urgent_count++;
+
+	win->count_ws = ws;
+	win->count_state = state;
+}
+
 static int
 count_win(struct workspace *ws, uint32_t flags)
 {
 	struct ws_win		*win;
-	int			count = 0;
+	int			count = 0, i;
+
+	/* Tiled/floating depends on focus state; only walk when asked. */
+	if ((flags & SWM_COUNT_TILED) && (flags & SWM_COUNT_FLOATING)) {
+		for (i = 0; i < SWM_WCOUNT_CLASSES; i++) {
+			if (!(flags & SWM_COUNT_ICONIC) &&
+			    i & SWM_WCOUNT_HIDDEN)
+				continue;
+			if (!(flags & SWM_COUNT_DESKTOP) &&
+			    i & SWM_WCOUNT_DESKTOP)
+				continue;
+			count += ws->win_count[i];
+		}
+		return (count);
+	}
 
 	TAILQ_FOREACH(win, &ws->winlist, entry) {
 		if (!(flags & SWM_COUNT_ICONIC) && HIDDEN(win))
@@ -6021,6 +7475,8 @@ update_stackable(struct swm_stackable *st, struct swm_stackable *st_sib)
 static void
 map_window(struct ws_win *win)
 {
+	uint32_t	wx;
+
 	if (win == NULL)
 		return;
 
@@ -6036,10 +7492,23 @@ map_window(struct ws_win *win)
 	if (win->mapped)
 		return;
 
+	pointer_cache.valid = false;
+	if (win->parked) {
+		/* Still mapped; only bring the frame back on-screen. */
+		win->parked = false;
+		wx = win_frame_x(win);
+		xcb_configure_window(conn, win->frame, XCB_CONFIG_WINDOW_X,
+		    &wx);
+		win->mapped = true;
+		set_win_state(win, XCB_ICCCM_WM_STATE_NORMAL);
+		return;
+	}
+
 	xcb_map_window(conn, win->frame);
 	xcb_map_window(conn, win->id);
 	if (win->debug != XCB_WINDOW_NONE)
 		xcb_map_window(conn, win->debug);
+	pointer_cache.valid = false;
 	win->mapping += 2;
 	win->mapped = true;
 	set_win_state(win, XCB_ICCCM_WM_STATE_NORMAL);
@@ -6048,6 +7517,8 @@ map_window(struct ws_win *win)
 static void
 unmap_window(struct ws_win *win)
 {
+	uint32_t	wx;
+
 	if (win == NULL)
 		return;
 
@@ -6060,16 +7531,70 @@ unmap_window(struct ws_win *win)
 		return;
 	}
 
-	if (!win->mapped)
+	if (!win->mapped && !win->parked)
 		return;
 
 	if (win->debug != XCB_WINDOW_NONE)
 		xcb_unmap_window(conn, win->debug);
 	xcb_unmap_window(conn, win->id);
 	xcb_unmap_window(conn, win->frame);
+	pointer_cache.valid = false;
 	win->unmapping += 2;
 	win->mapped = false;
+	if (win->parked) {
+		/* Restore the frame position for the next map. */
+		win->parked = false;
+		wx = win_frame_x(win);
+		xcb_configure_window(conn, win->frame, XCB_CONFIG_WINDOW_X,
+		    &wx);
+	}
+	set_win_state(win, XCB_ICCCM_WM_STATE_ICONIC);
+}
+
+/* Frame x position; parked frames end just left of the root origin. */
+static int32_t
+win_frame_x(struct ws_win *win)
+{
+	int32_t		w;
+
+	w = WIDTH(win) + (win->bordered ? 2 * border_width : 0);
+	if (win->parked)
+		return (-w);
+
+	return (X(win) - (win->bordered ? border_width : 0));
+}
+
+/*
+ * Keep a mapped window mapped but move its frame off-screen, so its client
+ * need not handle an unmap and remap when its workspace is shown again.
+ * WM_STATE is still set to Iconic, as for an unmapped window.
+ */
+static bool
+park_window(struct ws_win *win)
+{
+	uint32_t	wx;
+
+	if (win == NULL || !win_reparented(win) || !win->mapped)
+		return (false);
+
+	DNPRINTF(SWM_D_EVENT, "win %#x\n", win->id);
+
+	win->parked = true;
+	win->mapped = false;
+	wx = win_frame_x(win);
+	xcb_configure_window(conn, win->frame, XCB_CONFIG_WINDOW_X, &wx);
+	pointer_cache.valid = false;
 	set_win_state(win, XCB_ICCCM_WM_STATE_ICONIC);
+
+	return (true);
+}
+
+/* Hide a window whose workspace is no longer visible. */
+static void
+hide_window(struct ws_win *win)
+{
+	if (!workspace_park || !park_window(win))
+		unmap_window(win);
 }
 
 static void
@@ -6168,6 +7693,7 @@ reapply_quirks(struct ws_win *win)
 		}
 	}
 	free(name);
+	win_count_update(win);
 }
 
 static void
@@ -6177,7 +7703,10 @@ reload(struct swm_screen *s, struct binding *bp, union arg *args)
 	struct workspace	*ws;
 	struct stat		sb;
 	struct ws_win		*w;
-	int			i, num_screens;
+	uint32_t		sig[SWM_RELOAD_COUNT], changed = 0;
+	char			*old_fonts, *old_font_pua;
+	int			i, num_screens, old_bar_height;
+	bool			old_bar_extra;
 
 	/* Suppress warning. */
 	(void)s;
@@ -6199,34 +7728,28 @@ reload(struct swm_screen *s, struct binding *bp, union arg *args)
 	else
 		DNPRINTF(SWM_D_CONF, "using defaults\n");
 
+	/* Files are watched again as conf_load() opens them. */
+	conf_watch_clear();
+
+	/* Keep live state that is only rebuilt if its settings changed. */
+	memcpy(sig, conf_sig, sizeof sig);
+	memset(conf_sig, 0, sizeof conf_sig);
+	old_bar_extra = bar_extra;
+	old_bar_height = bar_height;
+	old_fonts = bar_fonts;
+	old_font_pua = bar_fontname_pua;
+	bar_fonts = NULL;
+	bar_fontname_pua = NULL;
+
 	/* Cleanup what will be restored to default. */
 
-	bar_extra_stop();
 	clear_quirks();
 	clear_spawns();
 	clear_bindings();
 
 	num_screens = get_screen_count();
-	for (i = 0; i < num_screens; i++) {
+	for (i = 0; i < num_screens; i++)
 		clear_colors(&screens[i]);
-		xft_free(&screens[i]);
-		TAILQ_FOREACH(r, &screens[i].rl, entry)
-			bar_cleanup(r);
-	}
-
-	if (bar_fontnames) {
-		for (i = 0; i < num_xftfonts; i++)
-			free(bar_fontnames[i]);
-		free(bar_fontnames);
-		bar_fontnames = NULL;
-		num_xftfonts = 0;
-		font_pua_index = 0;
-	}
-
-	if (bar_fs) {
-		XFreeFontSet(display, bar_fs);
-		bar_fs = NULL;
-	}
 
 	clear_startup_exceptions();
 
@@ -6246,7 +7769,59 @@ reload(struct swm_screen *s, struct binding *bp, union arg *args)
 		conf_load(conf_file, SWM_CONF_DEFAULT);
 
 	setup_marks();
-	setup_fonts();
+
+	/* Diff against the previous config; errors force a full reload. */
+	for (i = 0; i < SWM_RELOAD_COUNT; i++)
+		if (conf_sig[i] != sig[i])
+			changed |= (1 << i);
+	if (nr_exceptions)
+		changed = SWM_RELOAD_ALL;
+
+	DNPRINTF(SWM_D_CONF, "changed: %#x\n", changed);
+
+	if (changed & (1 << SWM_RELOAD_STATUS))
+		bar_extra_stop();
+	else
+		bar_extra = old_bar_extra;
+
+	if (changed & (1 << SWM_RELOAD_BAR)) {
+		free(old_fonts);
+		free(old_font_pua);
+
+		for (i = 0; i < num_screens; i++) {
+			xft_free(&screens[i]);
+			TAILQ_FOREACH(r, &screens[i].rl, entry)
+				bar_cleanup(r);
+		}
+
+		if (bar_fontnames) {
+			for (i = 0; i < num_xftfonts; i++)
+				free(bar_fontnames[i]);
+			free(bar_fontnames);
+			bar_fontnames = NULL;
+			num_xftfonts = 0;
+			font_pua_index = 0;
+		}
+
+		if (bar_fs) {
+			XFreeFontSet(display, bar_fs);
+			bar_fs = NULL;
+		}
+
+		setup_fonts();
+	} else {
+		/* Fonts are unchanged; only the new colors need Xft. */
+		free(bar_fonts);
+		free(bar_fontname_pua);
+		bar_fonts = old_fonts;
+		bar_fontname_pua = old_font_pua;
+		bar_height = old_bar_height;
+
+		if (!bar_font_legacy)
+			for (i = 0; i < num_screens; i++)
+				xft_init_colors(&screens[i]);
+	}
+
 	validate_spawns();
 
 	for (i = 0; i < num_screens; i++) {
@@ -6254,13 +7829,25 @@ reload(struct swm_screen *s, struct binding *bp, union arg *args)
 		TAILQ_FOREACH(r, &screens[i].orl, entry)
 			kill_refs_region(r);
 
-		TAILQ_FOREACH(r, &screens[i].rl, entry)
-			bar_setup(r);
+		if (changed & (1 << SWM_RELOAD_BAR))
+			TAILQ_FOREACH(r, &screens[i].rl, entry)
+				bar_setup(r);
 
 		/* Update quirks on currently managed windows. */
-		TAILQ_FOREACH(w, &screens[i].managed, manage_entry) {
-			reapply_quirks(w);
-			draw_frame(w);
+		if (changed & (1 << SWM_RELOAD_QUIRKS))
+			TAILQ_FOREACH(w, &screens[i].managed, manage_entry)
+				reapply_quirks(w);
+
+		if (changed & ~(1 << SWM_RELOAD_STATUS |
+		    1 << SWM_RELOAD_SOURCES | 1 << SWM_RELOAD_BINDINGS))
+			TAILQ_FOREACH(w, &screens[i].managed, manage_entry)
+				draw_frame(w);
+
+		/* Colors only need the frames and bars redrawn. */
+		if (!(changed & (1 << SWM_RELOAD_LAYOUT |
+		    1 << SWM_RELOAD_BAR | 1 << SWM_RELOAD_QUIRKS))) {
+			update_bars(&screens[i]);
+			continue;
 		}
 
 		refresh_stack(&screens[i]);
@@ -6291,8 +7878,18 @@ reload(struct swm_screen *s, struct binding *bp, union arg *args)
 		update_bars(&screens[i]);
 	}
 
-	grabkeys();
-	grabbuttons();
+	/*
+	 * A new status command without a bar rebuild must be started.
+	 * Sources are reconciled one by one, so they have no restart here.
+	 */
+	bar_extra_setup();
+
+	/* Grabs also depend on workspace_limit. */
+	if (changed & (1 << SWM_RELOAD_BINDINGS | 1 << SWM_RELOAD_LAYOUT)) {
+		grabkeys();
+		grabbuttons();
+	} else
+		update_keycodes();
 
 	DNPRINTF(SWM_D_CONF, "done\n");
 }
@@ -6331,29 +7928,68 @@ follow_pointer(struct swm_screen *s, unsigned int type)
 	return (result);
 }
 
+/*
+ * Root position of the pointer and, if child is set, the top-level window
+ * under it. When need_child, the position only has to lie within child and
+ * is served from pointer_cache if current; otherwise it is queried.
+ */
+static bool
+get_pointer(struct swm_screen *s, bool need_child, int *x, int *y,
+    xcb_window_t *child)
+{
+	struct pointer_cache		*pc = &pointer_cache;
+	xcb_query_pointer_reply_t	*qpr;
+
+	if (need_child && pc->valid && pc->root == s->root) {
+		*x = pc->x;
+		*y = pc->y;
+		if (child)
+			*child = pc->child;
+		return (true);
+	}
+
+	qpr = xcb_query_pointer_reply(conn,
+	    xcb_query_pointer(conn, s->root), NULL);
+	if (qpr == NULL)
+		return (false);
+
+	*x = qpr->root_x;
+	*y = qpr->root_y;
+	if (child)
+		*child = qpr->child;
+
+	if (qpr->same_screen) {
+		pc->valid = true;
+		pc->root = qpr->root;
+		pc->child = qpr->child;
+		pc->x = qpr->root_x;
+		pc->y = qpr->root_y;
+	}
+	free(qpr);
+
+	return (true);
+}
+
 static struct swm_region *
 get_pointer_region(struct swm_screen *s)
 {
 	struct swm_region		*r = NULL;
 	struct ws_win			*w;
-	xcb_query_pointer_reply_t	*qpr;
+	xcb_window_t			child;
+	int				x, y;
 
 	if (s == NULL)
 		return (NULL);
 
-	qpr = xcb_query_pointer_reply(conn,
-	    xcb_query_pointer(conn, s->root), NULL);
-	if (qpr) {
-		w = find_window(qpr->child);
+	if (get_pointer(s, true, &x, &y, &child)) {
+		w = find_window(child);
 		if (w && !win_free(w) && w->ws->r) {
-			pointer_window = qpr->child;
+			pointer_window = child;
 			r = w->ws->r;
 		} else {
-			DNPRINTF(SWM_D_MISC, "pointer: (%d,%d)\n", qpr->root_x,
-			    qpr->root_y);
-			r = region_under(s, qpr->root_x, qpr->root_y);
+			DNPRINTF(SWM_D_MISC, "pointer: (%d,%d)\n", x, y);
+			r = region_under(s, x, y);
 		}
-		free(qpr);
 	}
 
 	return (r);
@@ -6363,15 +7999,13 @@ static struct ws_win *
 get_pointer_win(struct swm_screen *s)
 {
 	struct ws_win			*win = NULL;
-	xcb_query_pointer_reply_t	*qpr;
+	xcb_window_t			child;
+	int				x, y;
 
-	qpr = xcb_query_pointer_reply(conn,
-	    xcb_query_pointer(conn, s->root), NULL);
-	if (qpr) {
-		win = find_window(qpr->child);
+	if (get_pointer(s, true, &x, &y, &child)) {
+		win = find_window(child);
 		if (win)
-			pointer_window = qpr->child;
-		free(qpr);
+			pointer_window = child;
 	}
 
 	return (win);
@@ -6420,6 +8054,7 @@ center_pointer(struct swm_region *r)
 #ifdef SWM_XCB_HAS_XINPUT
 	}
 #endif
+	pointer_cache.valid = false;
 }
 
 static xcb_window_t
@@ -6522,54 +8157,153 @@ find_bar(xcb_window_t id)
 	return (NULL);
 }
 
-static struct ws_win *
-find_win(xcb_window_t id)
+static struct ws_win *
+find_win(xcb_window_t id)
+{
+	struct ws_win		*win;
+	int			i, num_screens;
+
+	if (id == XCB_WINDOW_NONE)
+		return (NULL);
+
+	num_screens = get_screen_count();
+	for (i = 0; i < num_screens; i++)
+		TAILQ_FOREACH(win, &screens[i].managed, manage_entry)
+			if (id == win->id || id == win->frame)
+				return (win);
+
+	return (NULL);
+}
+
+static struct ws_win *
+find_win_frame(xcb_window_t id)
+{
+	struct ws_win		*win;
+	int			i, num_screens;
+
+	if (id == XCB_WINDOW_NONE)
+		return (NULL);
+
+	num_screens = get_screen_count();
+	for (i = 0; i < num_screens; i++)
+		TAILQ_FOREACH(win, &screens[i].managed, manage_entry)
+			if (id == win->frame)
+				return (win);
+
+	return (NULL);
+}
+
+static int
+subwin_cmp(struct subwin *sw1, struct subwin *sw2)
+{
+	if (sw1->id < sw2->id)
+		return (-1);
+	if (sw1->id > sw2->id)
+		return (1);
+	return (0);
+}
+
+static void
+subwin_insert(xcb_window_t id, xcb_window_t top, struct ws_win *win)
+{
+	struct subwin		*sw;
+
+	if ((sw = malloc(sizeof *sw)) == NULL)
+		err(1, "subwin_insert: malloc");
+
+	sw->id = id;
+	sw->top = top;
+	sw->win = win;
+	if (RB_INSERT(subwin_tree, &subwins, sw)) {
+		free(sw);
+		return;
+	}
+	SLIST_INSERT_HEAD(&win->subwins, sw, win_entry);
+}
+
+static void
+subwin_remove(struct subwin *sw)
 {
-	struct ws_win		*win;
-	int			i, num_screens;
+	RB_REMOVE(subwin_tree, &subwins, sw);
+	SLIST_REMOVE(&sw->win->subwins, sw, subwin, win_entry);
+	free(sw);
+}
 
-	if (id == XCB_WINDOW_NONE)
-		return (NULL);
+static struct subwin *
+subwin_lookup(xcb_window_t id)
+{
+	struct subwin		sw;
 
-	num_screens = get_screen_count();
-	for (i = 0; i < num_screens; i++)
-		TAILQ_FOREACH(win, &screens[i].managed, manage_entry)
-			if (id == win->id || id == win->frame)
-				return (win);
+	sw.id = id;
 
-	return (NULL);
+	return (RB_FIND(subwin_tree, &subwins, &sw));
 }
 
-static struct ws_win *
-find_win_frame(xcb_window_t id)
+/* Drop all cached subwindows of win. */
+static void
+clear_subwins(struct ws_win *win)
 {
-	struct ws_win		*win;
-	int			i, num_screens;
+	struct subwin		*sw;
 
-	if (id == XCB_WINDOW_NONE)
-		return (NULL);
+	while ((sw = SLIST_FIRST(&win->subwins))) {
+		SLIST_REMOVE_HEAD(&win->subwins, win_entry);
+		RB_REMOVE(subwin_tree, &subwins, sw);
+		free(sw);
+	}
+}
 
-	num_screens = get_screen_count();
-	for (i = 0; i < num_screens; i++)
-		TAILQ_FOREACH(win, &screens[i].managed, manage_entry)
-			if (id == win->frame)
-				return (win);
+/* Ancestry of id changed; descendants may be cached too so drop them all. */
+static void
+subwin_invalidate(xcb_window_t id)
+{
+	struct subwin		*sw;
+	struct ws_win		*win;
 
-	return (NULL);
+	if ((sw = subwin_lookup(id))) {
+		DNPRINTF(SWM_D_MISC, "id: %#x, top: %#x\n", id, sw->top);
+		clear_subwins(sw->win);
+	} else if ((win = find_win(id)))
+		clear_subwins(win);
 }
 
 static xcb_window_t
 get_top_level_window(xcb_window_t id)
 {
 	xcb_query_tree_reply_t	*qtr = NULL;
-	xcb_window_t		cwin = id;
+	xcb_window_t		cwin = id, path[SWM_SUBWIN_DEPTH_MAX];
+	const xcb_setup_t	*setup;
+	struct subwin		*sw;
+	struct ws_win		*win;
+	uint32_t		wa[1];
+	int			i, depth = 0;
+	bool			complete = true;
 
 	DNPRINTF(SWM_D_MISC, "id: %#x\n", id);
 
 	if (id == XCB_WINDOW_NONE)
 		return (XCB_WINDOW_NONE);
 
+	setup = xcb_get_setup(conn);
 	while (cwin != XCB_WINDOW_NONE) {
+		if ((sw = subwin_lookup(cwin))) {
+			DNPRINTF(SWM_D_MISC, "cached: %#x\n", cwin);
+			cwin = sw->top;
+			break;
+		}
+
+		/*
+		 * Watch client subwindows before asking for their parent, so a
+		 * later reparent or destroy is always reported.  Roots, our own
+		 * windows and managed clients already have their own masks.
+		 */
+		if ((cwin & ~setup->resource_id_mask) !=
+		    setup->resource_id_base && find_screen(cwin) == NULL &&
+		    find_win(cwin) == NULL) {
+			wa[0] = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+			xcb_change_window_attributes(conn, cwin,
+			    XCB_CW_EVENT_MASK, wa);
+		}
+
 		qtr = xcb_query_tree_reply(conn,
 		    xcb_query_tree(conn, cwin), NULL);
 		if (qtr == NULL) {
@@ -6582,10 +8316,23 @@ get_top_level_window(xcb_window_t id)
 			break;
 		}
 
+		if (depth < SWM_SUBWIN_DEPTH_MAX)
+			path[depth++] = cwin;
+		else
+			complete = false;
+
 		cwin = qtr->parent;
 		free(qtr);
 	}
 
+	/*
+	 * Only cache full paths below managed windows; an unwatched ancestor
+	 * could move the rest unnoticed.  Unmanage drops the entries.
+	 */
+	if (depth > 0 && complete && (win = find_win(cwin)))
+		for (i = 0; i < depth; i++)
+			subwin_insert(path[i], cwin, win);
+
 	DNPRINTF(SWM_D_MISC, "result: %#x\n", cwin);
 	return (cwin);
 }
@@ -6692,9 +8439,62 @@ spawn(int ws_idx, union arg *args, unsigned int flags)
 	_exit(1);
 }
 
-/* Cleanup all traces of a (possibly invalid) window pointer. */
+/* Cleanup all references to a managed window. */
 static void
 kill_refs(struct ws_win *win)
+{
+	struct workspace	*ws;
+	struct ws_win		*w, *tmpw, *m;
+	int			i, num_screens;
+
+	if (win == NULL)
+		return;
+
+	if (win->s->focus == win)
+		win->s->focus = NULL;
+
+	if (win->ws) {
+		if (win->ws->focus == win)
+			ws_set_focus(win->ws, NULL);
+		if (win->ws->focus_raise == win)
+			ws_set_focus_raise(win->ws, NULL);
+	}
+
+	/* Only walk workspaces when some other ws still refers to win. */
+	if (win->ws_refs > 0) {
+		num_screens = get_screen_count();
+		for (i = 0; i < num_screens; i++)
+			RB_FOREACH(ws, workspace_tree,
+			    &screens[i].workspaces) {
+				if (win == ws->focus)
+					ws_set_focus(ws, NULL);
+				if (win == ws->focus_raise)
+					ws_set_focus_raise(ws, NULL);
+			}
+	}
+
+	while ((w = TAILQ_FIRST(&win->redirects)))
+		win_set_focus_redirect(w, NULL);
+
+	while ((w = TAILQ_FIRST(&win->children))) {
+		win_set_parent(w, NULL);
+		win_set_main(w, w);
+	}
+
+	/* Children are detached; re-resolve the rest of the chain. */
+	TAILQ_FOREACH_SAFE(w, &win->dependents, dependent_entry, tmpw) {
+		m = find_main_window(w);
+		win_set_main(w, (m == win ? w : m));
+	}
+
+	win_set_focus_redirect(win, NULL);
+	win_set_parent(win, NULL);
+	win_set_main(win, win);
+}
+
+/* Cleanup all traces of an invalid window pointer. */
+static void
+kill_stale_refs(struct ws_win *win)
 {
 	struct workspace	*ws;
 	struct ws_win		*w;
@@ -6714,17 +8514,21 @@ kill_refs(struct ws_win *win)
 			if (win == ws->focus_raise)
 				ws->focus_raise = NULL;
 		}
+		/* Lists headed by win died with it; only clear the pointers. */
 		TAILQ_FOREACH(w, &screens[i].managed, manage_entry) {
 			if (win == w->focus_redirect)
 				w->focus_redirect = NULL;
-			if (win == w->parent) {
+			if (win == w->parent)
 				w->parent = NULL;
-				w->main = w;
-			}
 			if (win == w->main)
-				w->main = find_main_window(w);
+				w->main = w;
 		}
 	}
+
+	/* Re-resolve mains; win_set_main() unlinks from any live main. */
+	for (i = 0; i < num_screens; i++)
+		TAILQ_FOREACH(w, &screens[i].managed, manage_entry)
+			win_set_main(w, find_main_window(w));
 }
 
 /* Check if window pointer is still valid. */
@@ -6777,7 +8581,7 @@ unfocus_win(struct ws_win *win)
 
 	if (validate_win(win)) {
 		DNPRINTF(SWM_D_FOCUS, "invalid win\n");
-		kill_refs(win);
+		kill_stale_refs(win);
 		return;
 	}
 
@@ -6793,15 +8597,15 @@ unfocus_win(struct ws_win *win)
 		raise = win->ws->always_raise;
 
 		if (win->ws->focus == win) {
-			win->ws->focus = NULL;
+			ws_set_focus(win->ws, NULL);
 			if (win->ws->focus_raise == win) {
-				win->ws->focus_raise = NULL;
+				ws_set_focus_raise(win->ws, NULL);
 				raise = true;
 			}
 		}
 
 		if (validate_win(win->ws->focus)) {
-			kill_refs(win->ws->focus);
+			kill_stale_refs(win->ws->focus);
 			win->ws->focus = NULL;
 		}
 
@@ -6883,7 +8687,7 @@ focus_win(struct swm_screen *s, struct ws_win *win)
 	DNPRINTF(SWM_D_FOCUS, "win %#x\n", WINID(win));
 
 	if (validate_win(win)) {
-		kill_refs(win);
+		kill_stale_refs(win);
 		win = NULL;
 	}
 
@@ -7029,8 +8833,8 @@ set_focus(struct swm_screen *s, struct ws_win *win)
 	TAILQ_INSERT_HEAD(&s->fl, win, focus_entry);
 
 	if ((w = win->ws->focus) != win) {
-		win->ws->focus = win;
-		win->ws->focus_raise = NULL;
+		ws_set_focus(win->ws, win);
+		ws_set_focus_raise(win->ws, NULL);
 		if (w)
 			update_win_layer(w);
 		if (win->ws->always_raise)
@@ -7548,7 +9352,7 @@ unmap_workspace(struct workspace *ws)
 		return;
 
 	TAILQ_FOREACH(w, &ws->winlist, entry) {
-		unmap_window(w);
+		hide_window(w);
 		set_frame_focused(w, false);
 	}
 }
@@ -9054,6 +10858,8 @@ update_stacking(struct swm_screen *s)
 {
 	struct swm_stackable	*st, *st_prev;
 
+	pointer_cache.valid = false;
+
 	/* Stack windows from bottom up. */
 	st_prev = NULL;
 	SLIST_FOREACH(st, &s->stack, entry) {
@@ -9061,6 +10867,8 @@ update_stacking(struct swm_screen *s)
 		st_prev = st;
 	}
 	update_debug(s);
+
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_CLIENT_LIST_STACKING;
 }
 
 static void
@@ -9125,7 +10933,7 @@ transfer_win(struct ws_win *win, struct workspace *ws)
 
 	/* Set new focus on target ws. */
 	if (!follow && ws_focused(ows)) {
-		ws->focus = win;
+		ws_set_focus(ws, win);
 		set_focus(s, ows->focus);
 		draw_frame(get_ws_focus_prev(ws));
 	}
@@ -9189,19 +10997,127 @@ send_to_rg(struct swm_screen *s, struct binding *bp, union arg *args)
 	transfer_win(win, r->ws);
 }
 
+static int
+region_index_cmp(const void *a, const void *b)
+{
+	return (*(const int *)a - *(const int *)b);
+}
+
+/* Returns the cell containing v, or -1 if outside of the edges. */
+static int
+region_index_bisect(int *edges, int n, int v)
+{
+	int			lo = 0, hi = n - 1, mid;
+
+	if (n < 2 || v < edges[0] || v >= edges[n - 1])
+		return (-1);
+
+	/* Find lo such that edges[lo] <= v < edges[lo + 1]. */
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (edges[mid] <= v)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return (lo);
+}
+
+static void
+region_index_free(struct swm_screen *s)
+{
+	free(s->ri.xs);
+	free(s->ri.ys);
+	free(s->ri.cells);
+	s->ri.xs = s->ri.ys = NULL;
+	s->ri.cells = NULL;
+	s->ri.nx = s->ri.ny = 0;
+	s->ri.valid = false;
+}
+
+/*
+ * Split the screen along every region edge; each resulting cell is covered
+ * entirely by the first region in s->rl that overlaps it, if any.
+ */
+static void
+region_index_build(struct swm_screen *s)
+{
+	struct swm_region	*r;
+	int			n = 0, i, j, x0, x1, y0, y1, cols;
+
+	region_index_free(s);
+
+	TAILQ_FOREACH(r, &s->rl, entry)
+		n++;
+
+	if (n > 0) {
+		if ((s->ri.xs = calloc(2 * n, sizeof *s->ri.xs)) == NULL ||
+		    (s->ri.ys = calloc(2 * n, sizeof *s->ri.ys)) == NULL)
+			err(1, "region_index_build: calloc");
+
+		n = 0;
+		TAILQ_FOREACH(r, &s->rl, entry) {
+			s->ri.xs[n] = X(r);
+			s->ri.ys[n++] = Y(r);
+			s->ri.xs[n] = MAX_X(r);
+			s->ri.ys[n++] = MAX_Y(r);
+		}
+		qsort(s->ri.xs, n, sizeof *s->ri.xs, region_index_cmp);
+		qsort(s->ri.ys, n, sizeof *s->ri.ys, region_index_cmp);
+
+		/* Remove duplicate edges. */
+		for (i = 1, j = 0; i < n; i++)
+			if (s->ri.xs[i] != s->ri.xs[j])
+				s->ri.xs[++j] = s->ri.xs[i];
+		s->ri.nx = j + 1;
+		for (i = 1, j = 0; i < n; i++)
+			if (s->ri.ys[i] != s->ri.ys[j])
+				s->ri.ys[++j] = s->ri.ys[i];
+		s->ri.ny = j + 1;
+
+		cols = s->ri.nx - 1;
+		if ((s->ri.cells = calloc(cols * (s->ri.ny - 1) + 1,
+		    sizeof *s->ri.cells)) == NULL)
+			err(1, "region_index_build: calloc");
+
+		/* Fill in reverse so that earlier regions take precedence. */
+		TAILQ_FOREACH_REVERSE(r, &s->rl, swm_region_list, entry) {
+			x0 = region_index_bisect(s->ri.xs, s->ri.nx, X(r));
+			y0 = region_index_bisect(s->ri.ys, s->ri.ny, Y(r));
+			x1 = region_index_bisect(s->ri.xs, s->ri.nx,
+			    MAX_X(r) - 1);
+			y1 = region_index_bisect(s->ri.ys, s->ri.ny,
+			    MAX_Y(r) - 1);
+			if (x0 == -1 || y0 == -1 || x1 == -1 || y1 == -1)
+				continue;
+			for (j = y0; j <= y1; j++)
+				for (i = x0; i <= x1; i++)
+					s->ri.cells[j * cols + i] = r;
+		}
+	}
+	s->ri.valid = true;
+
+	DNPRINTF(SWM_D_MISC, "screen %d: %d x %d cells\n", s->idx,
+	    s->ri.nx - 1, s->ri.ny - 1);
+}
+
 static struct swm_region *
 region_under(struct swm_screen *s, int x, int y)
 {
-	struct swm_region	*r;
+	int			i, j;
 
 	if (s == NULL)
 		return (NULL);
 
-	TAILQ_FOREACH(r, &s->rl, entry)
-		if (X(r) <= x && x < MAX_X(r) && Y(r) <= y && y < MAX_Y(r))
-			break;
+	if (!s->ri.valid)
+		region_index_build(s);
 
-	return (r);
+	if ((i = region_index_bisect(s->ri.xs, s->ri.nx, x)) == -1 ||
+	    (j = region_index_bisect(s->ri.ys, s->ri.ny, y)) == -1)
+		return (NULL);
+
+	return (s->ri.cells[j * (s->ri.nx - 1) + i]);
 }
 
 /* Transfer focused window to target workspace and focus. */
@@ -9272,11 +11188,78 @@ update_win_refs(struct ws_win *win)
 	RB_FOREACH(ws, workspace_tree, &win->s->workspaces)
 		TAILQ_FOREACH(w, &ws->winlist, entry)
 			if (w->transient_for == win->id)
-				w->parent = win;
+				win_set_parent(w, win);
 
 	RB_FOREACH(ws, workspace_tree, &win->s->workspaces)
 		TAILQ_FOREACH(w, &ws->winlist, entry)
-			w->main = find_main_window(w);
+			win_set_main(w, find_main_window(w));
+}
+
+static void
+win_set_parent(struct ws_win *win, struct ws_win *parent)
+{
+	if (win->parent == parent)
+		return;
+
+	if (win->parent)
+		TAILQ_REMOVE(&win->parent->children, win, child_entry);
+	win->parent = parent;
+	if (parent)
+		TAILQ_INSERT_TAIL(&parent->children, win, child_entry);
+}
+
+/* A main window is its own main and is not on any dependents list. */
+static void
+win_set_main(struct ws_win *win, struct ws_win *m)
+{
+	if (win->main == m)
+		return;
+
+	if (win->main && win->main != win)
+		TAILQ_REMOVE(&win->main->dependents, win, dependent_entry);
+	win->main = m;
+	if (m && m != win)
+		TAILQ_INSERT_TAIL(&m->dependents, win, dependent_entry);
+}
+
+static void
+win_set_focus_redirect(struct ws_win *win, struct ws_win *target)
+{
+	if (win->focus_redirect == target)
+		return;
+
+	if (win->focus_redirect)
+		TAILQ_REMOVE(&win->focus_redirect->redirects, win,
+		    redirect_entry);
+	win->focus_redirect = target;
+	if (target)
+		TAILQ_INSERT_TAIL(&target->redirects, win, redirect_entry);
+}
+
+static void
+ws_set_focus(struct workspace *ws, struct ws_win *win)
+{
+	if (ws->focus == win)
+		return;
+
+	if (ws->focus)
+		ws->focus->ws_refs--;
+	ws->focus = win;
+	if (win)
+		win->ws_refs++;
+}
+
+static void
+ws_set_focus_raise(struct workspace *ws, struct ws_win *win)
+{
+	if (ws->focus_raise == win)
+		return;
+
+	if (ws->focus_raise)
+		ws->focus_raise->ws_refs--;
+	ws->focus_raise = win;
+	if (win)
+		win->ws_refs++;
 }
 
 /* Determine a window to consider 'main' for specified window. */
@@ -9322,11 +11305,12 @@ set_focus_redirect(struct ws_win *win)
 		/* Transient loop shouldn't occur. */
 		if (w->parent == win)
 			break;
-		w->parent->focus_redirect = w;
+		win_set_focus_redirect(w->parent, w);
 		w = w->parent;
 	}
 
-	win->focus_redirect = NULL; /* Clear any redirect from this window. */
+	/* Clear any redirect from this window. */
+	win_set_focus_redirect(win, NULL);
 }
 
 static void
@@ -9354,29 +11338,30 @@ win_to_ws(struct ws_win *win, struct workspace *nws, uint32_t flags)
 		if (win_related(w, win)) {
 			focused = (ws->focus == w);
 			if (focused) {
-				ws->focus = get_focus_other(w);
+				ws_set_focus(ws, get_focus_other(w));
 
 				if (flags & SWM_WIN_UNFOCUS)
 					unfocus_win(w);
 			}
 
-			/* Unmap if new ws is hidden. */
+			/* Hide if new ws is hidden. */
 			if (!(flags & SWM_WIN_NOUNMAP) && nws->r == NULL)
-				unmap_window(w);
+				hide_window(w);
 
 			/* Transfer */
 			TAILQ_REMOVE(&ws->winlist, w, entry);
 			TAILQ_INSERT_TAIL(&nws->winlist, w, entry);
 			w->ws = nws;
+			win_count_update(w);
 
 			if (focused)
-				nws->focus = w;
+				ws_set_focus(nws, w);
 
 			/* Cleanup references. */
 			if (ws->focus == w)
-				ws->focus = NULL;
+				ws_set_focus(ws, NULL);
 			if (ws->focus_raise == w)
-				ws->focus_raise = NULL;
+				ws_set_focus_raise(ws, NULL);
 
 			DNPRINTF(SWM_D_PROP, "win %#x, set property: "
 			    "_NET_WM_DESKTOP: %d\n", w->id, wsid);
@@ -9417,7 +11402,7 @@ raise_focus(struct swm_screen *s, struct binding *bp, union arg *args)
 	if (win == NULL || win_raised(win))
 		return;
 
-	win->ws->focus_raise = win;
+	ws_set_focus_raise(win->ws, win);
 	update_win_layer(win);
 	prioritize_window(win);
 	refresh_stack(s);
@@ -9729,98 +11714,165 @@ search_workspace(struct swm_screen *s, struct binding *bp, union arg *args)
 	fclose(lfile);
 }
 
+/* Unmap an indicator and return it to its screen's pool. */
+static void
+search_win_put(struct search_window *sw)
+{
+	xcb_unmap_window(conn, sw->indicator);
+	/* Keep it alive when the frame it was on is destroyed. */
+	xcb_reparent_window(conn, sw->indicator, sw->s->root, 0, 0);
+	sw->win = NULL;
+	TAILQ_INSERT_TAIL(&sw->s->search_pool, sw, entry);
+}
+
 static void
 search_win_cleanup(void)
 {
 	struct search_window	*sw = NULL;
 #ifndef __clang_analyzer__ /* Suppress false warnings. */
 	while ((sw = TAILQ_FIRST(&search_wl)) != NULL) {
-		xcb_destroy_window(conn, sw->indicator);
 		TAILQ_REMOVE(&search_wl, sw, entry);
-		free(sw);
+		search_win_put(sw);
 	}
 #endif
 }
 
+/* Release the indicator on a window whose frame is going away. */
+static void
+search_win_detach(struct ws_win *win)
+{
+	struct search_window	*sw, *nsw;
+
+	TAILQ_FOREACH_SAFE(sw, &search_wl, entry, nsw)
+		if (sw->win == win) {
+			TAILQ_REMOVE(&search_wl, sw, entry);
+			search_win_put(sw);
+		}
+}
+
+static void
+search_win_pool_free(struct swm_screen *s)
+{
+	struct search_window	*sw;
+
+	while ((sw = TAILQ_FIRST(&s->search_pool)) != NULL) {
+		TAILQ_REMOVE(&s->search_pool, sw, entry);
+		if (sw->draw)
+			XftDrawDestroy(sw->draw);
+		xcb_destroy_window(conn, sw->indicator);
+		free(sw);
+	}
+}
+
+/* Look up the digit glyphs once per font instead of per indicator. */
+static void
+search_digits_init(struct swm_screen *s)
+{
+	XftFont			*font = s->bar_xftfonts[0];
+	XGlyphInfo		info;
+	int			i;
+
+	if (s->sd.font == font)
+		return;
+
+	for (i = 0; i < 10; i++) {
+		s->sd.glyph[i] = XftCharIndex(display, font, '0' + i);
+		XftGlyphExtents(display, font, &s->sd.glyph[i], 1, &info);
+		s->sd.width[i] = info.xOff;
+	}
+	s->sd.font = font;
+}
+
 static int
 create_search_win(struct ws_win *win, int index)
 {
+	struct swm_screen	*s = win->s;
 	struct search_window	*sw = NULL;
-	xcb_window_t		w;
-	uint32_t		wa[3];
+	uint32_t		wa[3], wc[2];
 	uint32_t		offset;
 	int			width, height;
 	char			str[11];
-	size_t			len;
-	XftDraw			*draw;
-	XGlyphInfo		info;
+	size_t			len, i;
+	FT_UInt			glyphs[sizeof str];
 	GC			l_draw;
 	XGCValues		l_gcv;
 	XRectangle		l_ibox, l_lbox = {0, 0, 0, 0};
 
-	if ((sw = calloc(1, sizeof(struct search_window))) == NULL) {
-		warn("search_win: calloc");
-		return (1);
-	}
-	sw->idx = index;
-	sw->win = win;
-
 	snprintf(str, sizeof str, "%d", index);
 	len = strlen(str);
 
-	w = xcb_generate_id(conn);
-	wa[0] = getcolorpixel(win->s, SWM_S_COLOR_FOCUS, 0);
-	wa[1] = getcolorpixel(win->s, SWM_S_COLOR_UNFOCUS, 0);
-	wa[2] = win->s->colormap;
-
 	if (bar_font_legacy) {
 		TEXTEXTENTS(bar_fs, str, len, &l_ibox, &l_lbox);
 		width = l_lbox.width + 4;
 		height = bar_fs_extents->max_logical_extent.height + 4;
 	} else {
-		XftTextExtentsUtf8(display, win->s->bar_xftfonts[0],
-		    (FcChar8 *)str, len, &info);
-		width = info.xOff + 4;
-		height = win->s->bar_xftfonts[0]->height + 4;
+		search_digits_init(s);
+		width = 4;
+		for (i = 0; i < len; i++) {
+			glyphs[i] = s->sd.glyph[str[i] - '0'];
+			width += s->sd.width[str[i] - '0'];
+		}
+		height = s->bar_xftfonts[0]->height + 4;
 	}
 
 	offset = win_border(win);
-
-	xcb_create_window(conn, win->s->depth, w, win->frame, offset,
-	    offset, width, height, 1, XCB_WINDOW_CLASS_INPUT_OUTPUT,
-	    win->s->visual, XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL |
-	    XCB_CW_COLORMAP, wa);
-
-	xcb_map_window(conn, w);
-
-	sw->indicator = w;
+	wa[0] = getcolorpixel(s, SWM_S_COLOR_FOCUS, 0);
+	wa[1] = getcolorpixel(s, SWM_S_COLOR_UNFOCUS, 0);
+	wa[2] = s->colormap;
+
+	if ((sw = TAILQ_FIRST(&s->search_pool))) {
+		/* Reuse a pooled indicator; colors may have been reloaded. */
+		TAILQ_REMOVE(&s->search_pool, sw, entry);
+		xcb_change_window_attributes(conn, sw->indicator,
+		    XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL, wa);
+		xcb_reparent_window(conn, sw->indicator, win->frame, offset,
+		    offset);
+		wc[0] = width;
+		wc[1] = height;
+		xcb_configure_window(conn, sw->indicator,
+		    XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, wc);
+	} else {
+		if ((sw = calloc(1, sizeof(struct search_window))) == NULL) {
+			warn("search_win: calloc");
+			return (1);
+		}
+		sw->s = s;
+		sw->indicator = xcb_generate_id(conn);
+		xcb_create_window(conn, s->depth, sw->indicator, win->frame,
+		    offset, offset, width, height, 1,
+		    XCB_WINDOW_CLASS_INPUT_OUTPUT, s->visual,
+		    XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL | XCB_CW_COLORMAP,
+		    wa);
+	}
+	sw->idx = index;
+	sw->win = win;
 	TAILQ_INSERT_TAIL(&search_wl, sw, entry);
 
+	xcb_map_window(conn, sw->indicator);
+
 	if (bar_font_legacy) {
 		l_gcv.graphics_exposures = 0;
-		l_draw = XCreateGC(display, w, 0, &l_gcv);
+		l_draw = XCreateGC(display, sw->indicator, 0, &l_gcv);
 
 		XSetForeground(display, l_draw,
-			getcolorpixel(win->s, SWM_S_COLOR_BAR, 0));
+			getcolorpixel(s, SWM_S_COLOR_BAR, 0));
 
-		DRAWSTRING(display, w, bar_fs, l_draw, 2,
+		DRAWSTRING(display, sw->indicator, bar_fs, l_draw, 2,
 		    (bar_fs_extents->max_logical_extent.height -
 		    l_lbox.height) / 2 - l_lbox.y + 2, str, len);
 
 		XFreeGC(display, l_draw);
 	} else {
-		draw = XftDrawCreate(display, w, win->s->xvisual,
-		    win->s->colormap);
-
-		XftDrawStringUtf8(draw, getcolorxft(win->s, SWM_S_COLOR_BAR, 0),
-		    win->s->bar_xftfonts[0], 2, height - 2 -
-		    win->s->bar_xftfonts[0]->descent,
-		    (FcChar8 *)str, len);
+		if (sw->draw == NULL)
+			sw->draw = XftDrawCreate(display, sw->indicator,
+			    s->xvisual, s->colormap);
 
-		XftDrawDestroy(draw);
+		XftDrawGlyphs(sw->draw, getcolorxft(s, SWM_S_COLOR_BAR, 0),
+		    s->bar_xftfonts[0], 2, height - 2 -
+		    s->bar_xftfonts[0]->descent, glyphs, (int)len);
 	}
 
-	DNPRINTF(SWM_D_MISC, "mapped win %#x\n", w);
+	DNPRINTF(SWM_D_MISC, "mapped win %#x\n", sw->indicator);
 
 	return (0);
 }
@@ -9830,6 +11882,7 @@ search_win(struct swm_screen *s, struct binding *bp, union arg *args)
 {
 	struct swm_region	*r;
 	struct ws_win		*win = NULL;
+	struct search_window	*sw;
 	int			i;
 	FILE			*lfile;
 	char			*title;
@@ -9850,6 +11903,7 @@ search_win(struct swm_screen *s, struct binding *bp, union arg *args)
 	if ((lfile = fdopen(select_list_pipe[1], "w")) == NULL)
 		return;
 
+	/* Show all indicators before any name round trips. */
 	i = 1;
 	TAILQ_FOREACH(win, &r->ws->winlist, entry) {
 		if (HIDDEN(win))
@@ -9860,11 +11914,6 @@ search_win(struct swm_screen *s, struct binding *bp, union arg *args)
 			search_win_cleanup();
 			return;
 		}
-
-		title = get_win_name(win->id);
-		fprintf(lfile, "%d%s%s\n", i, (title ? ":" : ""),
-		    (title ? title : ""));
-		free(title);
 		i++;
 	}
 	/* Tack on 'free' wins. */
@@ -9877,12 +11926,16 @@ search_win(struct swm_screen *s, struct binding *bp, union arg *args)
 			search_win_cleanup();
 			return;
 		}
+		i++;
+	}
+	XFlush(display);
+	xcb_flush(conn);
 
-		title = get_win_name(win->id);
-		fprintf(lfile, "%d%s%s\n", i, (title ? ":" : ""),
+	TAILQ_FOREACH(sw, &search_wl, entry) {
+		title = get_win_name(sw->win->id);
+		fprintf(lfile, "%d%s%s\n", sw->idx, (title ? ":" : ""),
 		    (title ? title : ""));
 		free(title);
-		i++;
 	}
 
 	fclose(lfile);
@@ -9961,12 +12014,17 @@ search_resp_name_workspace(const char *resp, size_t len)
 	}
 
 	ewmh_update_desktop_names(search_r->s);
-	ewmh_get_desktop_names(search_r->s);
 	update_bars(search_r->s);
 }
 
 static void
 ewmh_update_desktop_names(struct swm_screen *s)
+{
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_DESKTOP_NAMES;
+}
+
+static void
+ewmh_set_desktop_names(struct swm_screen *s)
 {
 	struct workspace	*ws;
 	char			*name_list = NULL, *p;
@@ -9995,8 +12053,8 @@ ewmh_update_desktop_names(struct swm_screen *s)
 		tot += len + 1;
 	}
 
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
-	    ewmh[_NET_DESKTOP_NAMES].atom, a_utf8_string, 8, tot, name_list);
+	ewmh_set_root_prop(s, _NET_DESKTOP_NAMES, a_utf8_string, 8, tot,
+	    name_list);
 
 	free(name_list);
 }
@@ -10034,99 +12092,202 @@ ewmh_get_desktop_names(struct swm_screen *s)
 		}
 		++k;
 	}
-	free(gpr);
+	free(gpr);
+}
+
+/* Client list order changed; rewritten by the next ewmh_flush(). */
+static void
+ewmh_update_client_list(struct swm_screen *s)
+{
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_CLIENT_LIST |
+	    SWM_EWMH_DIRTY_CLIENT_LIST_STACKING;
+}
+
+static void
+ewmh_client_list_add(struct ws_win *win)
+{
+	struct swm_screen	*s = win->s;
+
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_CLIENT_LIST_STACKING;
+
+	if (s->ewmh_dirty & SWM_EWMH_DIRTY_CLIENT_LIST)
+		return;
+
+	/*
+	 * The list holds workspace window order, which is used to restore
+	 * tiling order on restart.  Appending keeps it valid only when win
+	 * is last on its workspace.
+	 */
+	if (TAILQ_NEXT(win, entry) != NULL) {
+		ewmh_update_client_list(s);
+		return;
+	}
+
+	DNPRINTF(SWM_D_PROP, "append win %#x\n", win->id);
+	xcb_change_property(conn, XCB_PROP_MODE_APPEND, s->root,
+	    ewmh[_NET_CLIENT_LIST].atom, XCB_ATOM_WINDOW, 32, 1, &win->id);
+	ewmh_root_prop_clear(s, _NET_CLIENT_LIST);
+}
+
+/* Forget the last written value so the next write always goes out. */
+static void
+ewmh_root_prop_clear(struct swm_screen *s, int hint)
+{
+	free(s->root_props[hint].data);
+	s->root_props[hint].data = NULL;
+	s->root_props[hint].len = 0;
+}
+
+/* Replace a root window property unless it already holds the value. */
+static void
+ewmh_set_root_prop(struct swm_screen *s, int hint, xcb_atom_t type,
+    uint8_t format, uint32_t n, const void *data)
+{
+	struct swm_root_prop	*rp = &s->root_props[hint];
+	uint32_t		len = n * (format / 8);
+
+	if (rp->data && rp->len == len && memcmp(rp->data, data, len) == 0) {
+		DNPRINTF(SWM_D_PROP, "skip %s; unchanged\n", ewmh[hint].name);
+		return;
+	}
+
+	DNPRINTF(SWM_D_PROP, "%s, len: %u\n", ewmh[hint].name, len);
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
+	    ewmh[hint].atom, type, format, n, data);
+
+	free(rp->data);
+	if ((rp->data = malloc(len + 1)) == NULL)
+		err(1, "ewmh_set_root_prop: malloc");
+	memcpy(rp->data, data, len);
+	rp->len = len;
 }
 
+/* Write pending root window properties. */
 static void
-ewmh_update_client_list(struct swm_screen *s)
+ewmh_flush(struct swm_screen *s)
 {
+	struct swm_stackable	*st;
+	struct swm_region	*r;
 	struct ws_win		*w;
 	struct workspace	*ws;
 	xcb_window_t		*wins;
+	uint32_t		*vals, val, vp[2];
 	int			i;
 
-	DNPRINTF(SWM_D_PROP, "win count: %d\n", s->managed_count);
-
-	if (s->managed_count == 0)
+	if (s->ewmh_dirty == 0)
 		return;
 
-	wins = calloc(s->managed_count, sizeof(xcb_window_t));
-	if (wins == NULL)
-		err(1, "ewmh_update_client_list: calloc");
+	DNPRINTF(SWM_D_PROP, "screen %d, dirty: %#x\n", s->idx, s->ewmh_dirty);
 
-	/* Save workspace window order. */
-	i = 0;
-	RB_FOREACH(ws, workspace_tree, &s->workspaces)
-		TAILQ_FOREACH(w, &ws->winlist, entry)
-			wins[i++] = w->id;
+	if (s->ewmh_dirty & SWM_EWMH_DIRTY_NUMBER_OF_DESKTOPS) {
+		val = workspace_limit;
+		ewmh_set_root_prop(s, _NET_NUMBER_OF_DESKTOPS,
+		    XCB_ATOM_CARDINAL, 32, 1, &val);
+	}
 
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
-	    ewmh[_NET_CLIENT_LIST].atom, XCB_ATOM_WINDOW, 32, s->managed_count,
-	    wins);
-	free(wins);
+	if (s->ewmh_dirty & SWM_EWMH_DIRTY_DESKTOP_VIEWPORT) {
+		/* Always (0,0) since regions are never larger than root. */
+		vp[0] = 0;
+		vp[1] = 0;
+		ewmh_set_root_prop(s, _NET_DESKTOP_VIEWPORT, XCB_ATOM_CARDINAL,
+		    32, 2, vp);
+	}
+
+	if (s->ewmh_dirty & SWM_EWMH_DIRTY_DESKTOP_NAMES)
+		ewmh_set_desktop_names(s);
+
+	if (s->ewmh_dirty & SWM_EWMH_DIRTY_WORKAREA) {
+		if ((vals = calloc(workspace_limit * 4, sizeof(uint32_t))) ==
+		    NULL)
+			err(1, "ewmh_flush: calloc");
+
+		DNPRINTF(SWM_D_MISC, "usable: x:%u y:%u w:%d h:%d\n",
+		    s->r->g_usable.x, s->r->g_usable.y, s->r->g_usable.w,
+		    s->r->g_usable.h);
+
+		/* The usable area of root applies to all desktops. */
+		for (i = 0; i < workspace_limit; ++i) {
+			vals[i * 4] = s->r->g_usable.x;
+			vals[i * 4 + 1] = s->r->g_usable.y;
+			vals[i * 4 + 2] = s->r->g_usable.w;
+			vals[i * 4 + 3] = s->r->g_usable.h;
+		}
+
+		ewmh_set_root_prop(s, _NET_WORKAREA, XCB_ATOM_CARDINAL, 32,
+		    workspace_limit * 4, vals);
+		free(vals);
+	}
+
+	if (s->ewmh_dirty & SWM_EWMH_DIRTY_CURRENT_DESKTOP &&
+	    (r = get_current_region(s))) {
+		val = r->ws->idx;
+		ewmh_set_root_prop(s, _NET_CURRENT_DESKTOP, XCB_ATOM_CARDINAL,
+		    32, 1, &val);
+	}
+
+	if (s->ewmh_dirty & (SWM_EWMH_DIRTY_CLIENT_LIST |
+	    SWM_EWMH_DIRTY_CLIENT_LIST_STACKING)) {
+		if ((wins = calloc(s->managed_count + 1,
+		    sizeof(xcb_window_t))) == NULL)
+			err(1, "ewmh_flush: calloc");
+
+		if (s->ewmh_dirty & SWM_EWMH_DIRTY_CLIENT_LIST) {
+			/* Save workspace window order. */
+			i = 0;
+			RB_FOREACH(ws, workspace_tree, &s->workspaces)
+				TAILQ_FOREACH(w, &ws->winlist, entry)
+					wins[i++] = w->id;
+
+			ewmh_set_root_prop(s, _NET_CLIENT_LIST,
+			    XCB_ATOM_WINDOW, 32, i, wins);
+		}
+
+		if (s->ewmh_dirty & SWM_EWMH_DIRTY_CLIENT_LIST_STACKING) {
+			/* Stack list is ordered bottom to top. */
+			i = 0;
+			SLIST_FOREACH(st, &s->stack, entry)
+				if (st->type == STACKABLE_WIN &&
+				    st->win->id != XCB_WINDOW_NONE &&
+				    i < s->managed_count)
+					wins[i++] = st->win->id;
+
+			ewmh_set_root_prop(s, _NET_CLIENT_LIST_STACKING,
+			    XCB_ATOM_WINDOW, 32, i, wins);
+		}
+		free(wins);
+	}
+
+	if (s->ewmh_dirty & SWM_EWMH_DIRTY_ACTIVE_WINDOW)
+		ewmh_set_root_prop(s, _NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, 32,
+		    1, &s->active_window);
+
+	s->ewmh_dirty = 0;
 }
 
 static void
 ewmh_update_current_desktop(struct swm_screen *s)
 {
-	struct swm_region	*r;
-	uint32_t		val;
-
-	if ((r = get_current_region(s)) == NULL)
-		return;
-
-	val = r->ws->idx;
-
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
-	    ewmh[_NET_CURRENT_DESKTOP].atom, XCB_ATOM_CARDINAL, 32, 1, &val);
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_CURRENT_DESKTOP;
 }
 
 static void
 ewmh_update_number_of_desktops(struct swm_screen *s)
 {
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
-	    ewmh[_NET_NUMBER_OF_DESKTOPS].atom, XCB_ATOM_CARDINAL, 32, 1,
-	    &workspace_limit);
+	/* Per-desktop properties depend on the number of desktops. */
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_NUMBER_OF_DESKTOPS |
+	    SWM_EWMH_DIRTY_DESKTOP_VIEWPORT | SWM_EWMH_DIRTY_WORKAREA;
 }
 
 static void
 ewmh_update_desktop_viewports(struct swm_screen *s)
 {
-	uint32_t	vals[2];
-
-	/* Always (0,0) since regions are never larger than root. */
-	vals[0] = 0;
-	vals[1] = 0;
-
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
-	    ewmh[_NET_DESKTOP_VIEWPORT].atom, XCB_ATOM_CARDINAL, 32, 2, &vals);
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_DESKTOP_VIEWPORT;
 }
 
 static void
 ewmh_update_workarea(struct swm_screen *s)
 {
-	int			i;
-	uint32_t		*vals;
-
-	if ((vals = calloc(workspace_limit * 4, sizeof(uint32_t))) == NULL)
-		err(1, "ewmh_update_workarea: calloc");
-
-	DNPRINTF(SWM_D_MISC, "usable: x:%u y:%u w:%d h:%d\n", s->r->g_usable.x,
-	    s->r->g_usable.y, s->r->g_usable.w, s->r->g_usable.h);
-
-	/* The usable area of root applies to all desktops. */
-	for (i = 0; i < workspace_limit; ++i) {
-		vals[i * 4] = s->r->g_usable.x;
-		vals[i * 4 + 1] = s->r->g_usable.y;
-		vals[i * 4 + 2] = s->r->g_usable.w;
-		vals[i * 4 + 3] = s->r->g_usable.h;
-	}
-
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, s->root,
-	    ewmh[_NET_WORKAREA].atom, XCB_ATOM_CARDINAL, 32,
-	    workspace_limit * 4, vals);
-
-	free(vals);
+	s->ewmh_dirty |= SWM_EWMH_DIRTY_WORKAREA;
 }
 
 static void
@@ -10199,24 +12360,36 @@ search_do_resp(void)
 {
 	ssize_t			rbytes;
 	char			*resp;
-	size_t			len;
+	size_t			len = 0;
 
 	DNPRINTF(SWM_D_MISC, "begin\n");
 
-	search_resp = 0;
+	/* Clear the pid first so a late SIGCHLD cannot flag it again. */
 	searchpid = 0;
+	search_resp = 0;
 
 	if ((resp = calloc(1, MAX_RESP_LEN + 1)) == NULL) {
 		warn("search: calloc");
 		goto done;
 	}
 
-	rbytes = read(select_resp_pipe[0], resp, MAX_RESP_LEN);
-	if (rbytes <= 0) {
+	/* The writer is gone; collect every chunk up to the first line. */
+	while (len < MAX_RESP_LEN && (rbytes = read(select_resp_pipe[0],
+	    resp + len, MAX_RESP_LEN - len)) != 0) {
+		if (rbytes == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		len += rbytes;
+		if (memchr(resp, '\n', len))
+			break;
+	}
+	if (len == 0) {
 		warn("search: read error");
 		goto done;
 	}
-	resp[rbytes] = '\0';
+	resp[len] = '\0';
 
 	/* XXX:
 	 * Older versions of dmenu (Atleast pre 4.4.1) do not send a
@@ -10802,14 +12975,15 @@ update_window(struct ws_win *win)
 	    XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
 	    XCB_CONFIG_WINDOW_BORDER_WIDTH;
 
-	/* Reconfigure frame. */
+	pointer_cache.valid = false;
+
+	/* Reconfigure frame; a parked frame stays off-screen. */
+	wc[0] = win_frame_x(win);
 	if (win->bordered) {
-		wc[0] = X(win) - border_width;
 		wc[1] = Y(win) - border_width;
 		wc[2] = WIDTH(win) + 2 * border_width;
 		wc[3] = HEIGHT(win) + 2 * border_width;
 	} else {
-		wc[0] = X(win);
 		wc[1] = Y(win);
 		wc[2] = WIDTH(win);
 		wc[3] = HEIGHT(win);
@@ -10876,6 +13050,44 @@ put_back_event(xcb_generic_event_t *evt)
 	STAILQ_INSERT_HEAD(&events, ep, entry);
 }
 
+/* Queue readable events; true if they are nothing but XI2 raw input. */
+static bool
+pending_raw_input_only(void)
+{
+	xcb_generic_event_t	*evt;
+	struct event		*ep;
+	bool			raw = false;
+
+	/* Already queued events have been seen by a handler. */
+	if (!STAILQ_EMPTY(&events))
+		return (false);
+
+	while ((evt = xcb_poll_for_event(conn))) {
+		if ((ep = malloc(sizeof (struct event))) == NULL)
+			err(1, "pending_raw_input_only: malloc");
+		ep->ev = evt;
+		STAILQ_INSERT_TAIL(&events, ep, entry);
+
+#if defined(SWM_XCB_HAS_XINPUT) && defined(XCB_INPUT_RAW_BUTTON_PRESS)
+		if (xinput2_support &&
+		    XCB_EVENT_RESPONSE_TYPE(evt) == XCB_GE_GENERIC &&
+		    ((xcb_ge_generic_event_t *)evt)->extension ==
+		    xinput2_opcode &&
+		    ((xcb_ge_generic_event_t *)evt)->event_type >=
+		    XCB_INPUT_RAW_KEY_PRESS &&
+		    ((xcb_ge_generic_event_t *)evt)->event_type <=
+		    XCB_INPUT_RAW_MOTION) {
+			raw = true;
+			continue;
+		}
+#endif
+		/* Anything else may change what the bars show. */
+		return (false);
+	}
+
+	return (raw);
+}
+
 /* Peeks at next event to detect auto-repeat. */
 static bool
 keyrepeating(xcb_key_release_event_t *kre)
@@ -10911,8 +13123,8 @@ static void
 resize_win(struct ws_win *win, struct binding *bp, int opt)
 {
 	struct swm_geometry		b;
-	xcb_query_pointer_reply_t	*xpr = NULL;
 	uint32_t			dir;
+	int				x, y;
 	bool				inplace = false, step = false;
 
 	if (win == NULL)
@@ -10973,21 +13185,21 @@ resize_win(struct ws_win *win, struct binding *bp, int opt)
 	    SWM_CW_ALLSIDES | SWM_CW_RESIZABLE | SWM_CW_SOFTBOUNDARY);
 	update_window(win);
 
-	/* get cursor offset from window root */
-	xpr = xcb_query_pointer_reply(conn, xcb_query_pointer(conn, win->id),
-	    NULL);
-	if (xpr == NULL)
+	/* Use the triggering press if there was one, otherwise query. */
+	if (press_pos.valid && press_pos.root == win->s->root) {
+		x = press_pos.x;
+		y = press_pos.y;
+	} else if (!get_pointer(win->s, false, &x, &y, NULL))
 		return;
 
+	/* Cursor offset from window origin picks the edges to move. */
 	dir = SWM_SIZE_HORZ | SWM_SIZE_VERT;
-	if (xpr->win_x < WIDTH(win) / 2)
+	if (x - X(win) < WIDTH(win) / 2)
 		dir |= SWM_SIZE_HFLIP;
-	if (xpr->win_y < HEIGHT(win) / 2)
+	if (y - Y(win) < HEIGHT(win) / 2)
 		dir |= SWM_SIZE_VFLIP;
 
-	resize_win_pointer(win, bp, xpr->root_x, xpr->root_y, dir,
-	    (opt == SWM_ARG_ID_CENTER));
-	free(xpr);
+	resize_win_pointer(win, bp, x, y, dir, (opt == SWM_ARG_ID_CENTER));
 	DNPRINTF(SWM_D_EVENT, "done\n");
 }
 
@@ -11318,7 +13530,7 @@ unsnap_win(struct ws_win *win, bool inplace)
 static void
 move_win(struct ws_win *win, struct binding *bp, int opt)
 {
-	xcb_query_pointer_reply_t	*qpr = NULL;
+	int				x, y;
 	bool				step = false, inplace;
 
 	if (win == NULL)
@@ -11369,14 +13581,16 @@ move_win(struct ws_win *win, struct binding *bp, int opt)
 		return;
 	}
 
-	/* get cursor offset from window root */
-	qpr = xcb_query_pointer_reply(conn, xcb_query_pointer(conn, win->id),
-		NULL);
-	if (qpr == NULL)
+	/* Use the triggering press if there was one, otherwise query. */
+	if (press_pos.valid && press_pos.root == win->s->root) {
+		move_win_pointer(win, bp, press_pos.x, press_pos.y);
+		goto out;
+	}
+
+	if (!get_pointer(win->s, false, &x, &y, NULL))
 		return;
 
-	move_win_pointer(win, bp, qpr->root_x, qpr->root_y);
-	free(qpr);
+	move_win_pointer(win, bp, x, y);
 out:
 	DNPRINTF(SWM_D_EVENT, "done\n");
 }
@@ -12507,6 +14721,8 @@ binding_insert(uint16_t mod, enum binding_type type, uint32_t val,
 	bp->flags = flags;
 	bp->num = num;
 	bp->spawn_name = strdupsafe(spawn_name);
+	if (type == KEYBIND)
+		key_dispatch_clear();
 	if (RB_INSERT(binding_tree, &bindings, bp))
 		errx(1, "binding_insert: RB_INSERT");
 
@@ -12532,6 +14748,8 @@ binding_remove(struct binding *bp)
 	    "spawn_name: %s\n", bp->mod, bp->type, bp->value,
 	    actions[bp->action].name, bp->action, bp->spawn_name);
 
+	if (bp->type == KEYBIND)
+		key_dispatch_clear();
 	RB_REMOVE(binding_tree, &bindings, bp);
 	free(bp->spawn_name);
 	free(bp);
@@ -12539,6 +14757,75 @@ binding_remove(struct binding *bp)
 	DNPRINTF(SWM_D_KEY, "leave\n");
 }
 
+static void
+key_dispatch_clear(void)
+{
+	int			i;
+
+	if (!key_dispatch_valid)
+		return;
+
+	for (i = 0; i < LENGTH(key_dispatch); i++) {
+		free(key_dispatch[i]);
+		key_dispatch[i] = NULL;
+	}
+	key_dispatch_valid = false;
+}
+
+/* Resolve key bindings for every keycode in the current keyboard mapping. */
+static void
+key_dispatch_build(void)
+{
+	const xcb_setup_t	*s;
+	struct binding		*bp, *anybp, key;
+	struct binding		**row;
+	xcb_keycode_t		kc;
+	xcb_keysym_t		ks;
+	int			i;
+
+	key_dispatch_clear();
+
+	s = get_setup();
+	/* Keycodes are unsigned, bail if kc++ is reduced to 0. */
+	for (kc = s->min_keycode; kc > 0 && kc <= s->max_keycode; kc++) {
+		/* Key events are looked up by the first keysym column. */
+		ks = xcb_key_symbols_get_keysym(syms, kc, 0);
+		if (ks == XCB_NO_SYMBOL)
+			continue;
+
+		key.type = KEYBIND;
+		key.value = ks;
+		key.mod = 0;
+		bp = RB_NFIND(binding_tree, &bindings, &key);
+		if (bp == NULL || bp->type != KEYBIND || bp->value != ks)
+			continue;
+
+		if ((row = calloc(SWM_KEY_DISPATCH_MODS, sizeof *row)) == NULL)
+			err(1, "key_dispatch_build: calloc");
+
+		anybp = NULL;
+		for (; bp && bp->type == KEYBIND && bp->value == ks;
+		    bp = RB_NEXT(binding_tree, &bindings, bp)) {
+			if (bp->mod == ANYMOD)
+				anybp = bp;
+			else if (bp->mod < SWM_KEY_DISPATCH_MODS &&
+			    !(bp->mod & XCB_MOD_MASK_LOCK))
+				row[bp->mod] = bp;
+		}
+
+		/* Fill remaining states with the catch-all. */
+		if (anybp)
+			for (i = 0; i < SWM_KEY_DISPATCH_MODS; i++)
+				if (row[i] == NULL)
+					row[i] = anybp;
+
+		key_dispatch[kc] = row;
+	}
+	key_dispatch_valid = true;
+
+	DNPRINTF(SWM_D_KEY, "done\n");
+}
+
 static void
 setbinding(uint16_t mod, enum binding_type type, uint32_t val, uint32_t flags,
     enum actionid aid, int num, const char *spawn_name)
@@ -12869,6 +15156,11 @@ updatenumlockmask(void)
 	xcb_get_modifier_mapping_reply_t	*modmap_r;
 	xcb_keycode_t				*modmap, kc, *keycode;
 
+	/* Only refetched after the modifier map changed. */
+	if (numlockmask_valid)
+		return;
+	numlockmask_valid = true;
+
 	numlockmask = 0;
 
 	modmap_r = xcb_get_modifier_mapping_reply(conn,
@@ -12915,45 +15207,109 @@ static xcb_keycode_t
 get_keysym_keycode(xcb_keysym_t ks)
 {
 	const xcb_setup_t			*s;
-	xcb_get_keyboard_mapping_reply_t	*kmr;
-	int					col;
+	int					col, cols;
 	xcb_keycode_t				kc, min, max;
 
 	s = get_setup();
 	min = s->min_keycode;
 	max = s->max_keycode;
 
-	kmr = xcb_get_keyboard_mapping_reply(conn,
-	    xcb_get_keyboard_mapping(conn, min, max - min + 1), NULL);
-	if (kmr == NULL)
-		return (XCB_NO_SYMBOL);
-
-	/* Search for keycode by keysym column. */
-	for (col = 0; col < kmr->keysyms_per_keycode; col++) {
+	/* Search the cached mapping for keycode by keysym column. */
+	cols = get_keysyms_per_keycode();
+	for (col = 0; col < cols; col++) {
 		/* Keycodes are unsigned, bail if kc++ is reduced to 0. */
-		for (kc = min; kc > 0 && kc <= max; kc++) {
-			if (xcb_key_symbols_get_keysym(syms, kc, col) == ks) {
-				free(kmr);
+		for (kc = min; kc > 0 && kc <= max; kc++)
+			if (xcb_key_symbols_get_keysym(syms, kc, col) == ks)
 				return (kc);
-			}
-		}
 	}
-	free(kmr);
 
 	return (XCB_NO_SYMBOL);
 }
 
+/* Width of the keyboard mapping; fetched once per mapping change. */
+static int
+get_keysyms_per_keycode(void)
+{
+	xcb_get_keyboard_mapping_reply_t	*kmr;
+
+	if (keysyms_per_keycode > 0)
+		return (keysyms_per_keycode);
+
+	kmr = xcb_get_keyboard_mapping_reply(conn,
+	    xcb_get_keyboard_mapping(conn, get_setup()->min_keycode, 1), NULL);
+	if (kmr) {
+		keysyms_per_keycode = kmr->keysyms_per_keycode;
+		free(kmr);
+	}
+
+	return (keysyms_per_keycode);
+}
+
+static int
+key_grab_cmp(struct key_grab *kg1, struct key_grab *kg2)
+{
+	if (kg1->keycode < kg2->keycode)
+		return (-1);
+	if (kg1->keycode > kg2->keycode)
+		return (1);
+
+	if (kg1->mod < kg2->mod)
+		return (-1);
+	if (kg1->mod > kg2->mod)
+		return (1);
+
+	return (0);
+}
+
+/* Mark a grab as wanted, adding it if it is not held yet. */
+static void
+key_grab_want(struct swm_screen *s, xcb_keycode_t keycode, uint16_t mod)
+{
+	struct key_grab		kgf, *kg;
+
+	kgf.keycode = keycode;
+	kgf.mod = mod;
+	if ((kg = RB_FIND(key_grab_tree, &s->key_grabs, &kgf)) != NULL) {
+		if (kg->state == SWM_GRAB_STALE)
+			kg->state = SWM_GRAB_KEEP;
+		return;
+	}
+
+	if ((kg = calloc(1, sizeof *kg)) == NULL)
+		err(1, "key_grab_want: calloc");
+	kg->keycode = keycode;
+	kg->mod = mod;
+	kg->state = SWM_GRAB_NEW;
+	RB_INSERT(key_grab_tree, &s->key_grabs, kg);
+}
+
+static void
+clear_key_grabs(struct swm_screen *s)
+{
+	struct key_grab		*kg;
+
+	while ((kg = RB_ROOT(&s->key_grabs))) {
+		RB_REMOVE(key_grab_tree, &s->key_grabs, kg);
+		free(kg);
+	}
+}
+
+/* Bring the key grabs on each root in line with the bindings. */
 static void
 grabkeys(void)
 {
 	struct binding		*bp;
-	int			num_screens, i, j;
+	struct key_grab		*kg, *nkg, *kgr, **pending = NULL;
+	xcb_void_cookie_t	*cookies = NULL;
+	xcb_generic_error_t	*error;
+	int			num_screens, i, j, count, npending;
 	uint16_t		modifiers[4];
 	xcb_keycode_t		keycode;
 
 	DNPRINTF(SWM_D_MISC, "begin\n");
 	updatenumlockmask();
 	update_keycodes();
+	key_dispatch_build();
 
 	modifiers[0] = 0;
 	modifiers[1] = numlockmask;
@@ -12964,8 +15320,10 @@ grabkeys(void)
 	for (i = 0; i < num_screens; i++) {
 		if (TAILQ_EMPTY(&screens[i].rl))
 			continue;
-		xcb_ungrab_key(conn, XCB_GRAB_ANY, screens[i].root,
-			XCB_MOD_MASK_ANY);
+
+		RB_FOREACH(kg, key_grab_tree, &screens[i].key_grabs)
+			kg->state = SWM_GRAB_STALE;
+
 		RB_FOREACH(bp, binding_tree, &bindings) {
 			if (bp->type != KEYBIND)
 				continue;
@@ -12985,26 +15343,82 @@ grabkeys(void)
 			if (keycode == XCB_NO_SYMBOL)
 				continue;
 
-			if (bp->mod == XCB_MOD_MASK_ANY) {
+			if (bp->mod == XCB_MOD_MASK_ANY)
 				/* All modifiers are grabbed in one pass. */
-				DNPRINTF(SWM_D_KEY, "key: %u, modmask: %d\n",
-				    bp->value, bp->mod);
-				xcb_grab_key(conn, 1, screens[i].root, bp->mod,
-				    keycode, XCB_GRAB_MODE_ASYNC,
-				    XCB_GRAB_MODE_SYNC);
-			} else {
+				key_grab_want(&screens[i], keycode, bp->mod);
+			else
 				/* Need to grab each modifier permutation. */
-				for (j = 0; j < LENGTH(modifiers); j++) {
-					DNPRINTF(SWM_D_KEY, "key: %u, "
-					    "modmask: %d\n", bp->value,
+				for (j = 0; j < LENGTH(modifiers); j++)
+					key_grab_want(&screens[i], keycode,
 					    bp->mod | modifiers[j]);
-					xcb_grab_key(conn, 1, screens[i].root,
-					    bp->mod | modifiers[j], keycode,
-					    XCB_GRAB_MODE_ASYNC,
-					    XCB_GRAB_MODE_SYNC);
-				}
+		}
+
+		/*
+		 * Release stale grabs first; releasing an AnyModifier grab
+		 * also drops any other grab held on that keycode.
+		 */
+		RB_FOREACH_SAFE(kg, key_grab_tree, &screens[i].key_grabs,
+		    nkg) {
+			if (kg->state != SWM_GRAB_STALE)
+				continue;
+
+			DNPRINTF(SWM_D_KEY, "ungrab keycode: %u, modmask: "
+			    "%#x\n", kg->keycode, kg->mod);
+			xcb_ungrab_key(conn, kg->keycode, screens[i].root,
+			    kg->mod);
+			if (kg->mod == XCB_MOD_MASK_ANY)
+				RB_FOREACH(kgr, key_grab_tree,
+				    &screens[i].key_grabs)
+					if (kgr->keycode == kg->keycode &&
+					    kgr->state == SWM_GRAB_KEEP)
+						kgr->state = SWM_GRAB_NEW;
+			RB_REMOVE(key_grab_tree, &screens[i].key_grabs, kg);
+			free(kg);
+		}
+
+		/* Issue new grabs, then collect all replies in one batch. */
+		count = 0;
+		RB_FOREACH(kg, key_grab_tree, &screens[i].key_grabs)
+			if (kg->state == SWM_GRAB_NEW)
+				count++;
+		if (count == 0)
+			continue;
+
+		if ((pending = calloc(count, sizeof *pending)) == NULL ||
+		    (cookies = calloc(count, sizeof *cookies)) == NULL)
+			err(1, "grabkeys: calloc");
+
+		npending = 0;
+		RB_FOREACH(kg, key_grab_tree, &screens[i].key_grabs) {
+			if (kg->state != SWM_GRAB_NEW)
+				continue;
+
+			DNPRINTF(SWM_D_KEY, "grab keycode: %u, modmask: %#x\n",
+			    kg->keycode, kg->mod);
+			cookies[npending] = xcb_grab_key_checked(conn, 1,
+			    screens[i].root, kg->mod, kg->keycode,
+			    XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_SYNC);
+			pending[npending++] = kg;
+			kg->state = SWM_GRAB_KEEP;
+		}
+
+		for (j = 0; j < npending; j++) {
+			if ((error = xcb_request_check(conn, cookies[j]))) {
+				/* Most likely held by another client. */
+				warnx("unable to grab keycode %u, modmask %#x: "
+				    "error %u", pending[j]->keycode,
+				    pending[j]->mod, error->error_code);
+				free(error);
+				RB_REMOVE(key_grab_tree, &screens[i].key_grabs,
+				    pending[j]);
+				free(pending[j]);
 			}
 		}
+
+		free(pending);
+		free(cookies);
+		pending = NULL;
+		cookies = NULL;
 	}
 	DNPRINTF(SWM_D_MISC, "done\n");
 }
@@ -13204,10 +15618,15 @@ rawbuttonpress(xcb_input_raw_button_press_event_t *e)
 	click_focus(s, qpr->child, qpr->root_x, qpr->root_y);
 
 	if ((ap = &actions[bp->action])) {
+		press_pos.valid = true;
+		press_pos.root = qpr->root;
+		press_pos.x = qpr->root_x;
+		press_pos.y = qpr->root_y;
 		if (bp->action == FN_SPAWN_CUSTOM)
 			spawn_custom(s, &ap->args, bp->spawn_name);
 		else if (ap->func)
 			ap->func(s, bp, &ap->args);
+		press_pos.valid = false;
 	}
 	flush();
 out:
@@ -13835,6 +16254,7 @@ setup_quirks(void)
 enum {
 	SWM_S_BAR_ACTION,
 	SWM_S_BAR_ACTION_EXPAND,
+	SWM_S_BAR_ACTION_KEYED,
 	SWM_S_BAR_AT_BOTTOM,
 	SWM_S_BAR_BORDER_WIDTH,
 	SWM_S_BAR_ENABLED,
@@ -13892,6 +16312,7 @@ enum {
 	SWM_S_WORKSPACE_AUTOROTATE,
 	SWM_S_WORKSPACE_CLAMP,
 	SWM_S_WORKSPACE_LIMIT,
+	SWM_S_WORKSPACE_PARK,
 	SWM_S_WORKSPACE_INDICATOR,
 	SWM_S_WORKSPACE_NAME,
 	SWM_S_FOCUS_MARK_NONE,
@@ -13938,6 +16359,9 @@ setconfvalue(uint8_t asop, const char *selector, const char *value, int flags,
 	case SWM_S_BAR_ACTION_EXPAND:
 		bar_action_expand = (atoi(value) != 0);
 		break;
+	case SWM_S_BAR_ACTION_KEYED:
+		bar_action_keyed = (atoi(value) != 0);
+		break;
 	case SWM_S_BAR_AT_BOTTOM:
 		bar_at_bottom = (atoi(value) != 0);
 		break;
@@ -14251,6 +16675,9 @@ setconfvalue(uint8_t asop, const char *selector, const char *value, int flags,
 	case SWM_S_WORKSPACE_CLAMP:
 		workspace_clamp = (atoi(value) != 0);
 		break;
+	case SWM_S_WORKSPACE_PARK:
+		workspace_park = (atoi(value) != 0);
+		break;
 	case SWM_S_WORKSPACE_LIMIT:
 		workspace_limit = atoi(value);
 		if (workspace_limit > SWM_WS_MAX)
@@ -14293,7 +16720,6 @@ setconfvalue(uint8_t asop, const char *selector, const char *value, int flags,
 					err(1, "setconfvalue: name strdup");
 
 				ewmh_update_desktop_names(&screens[i]);
-				ewmh_get_desktop_names(&screens[i]);
 			}
 		}
 		break;
@@ -14511,6 +16937,70 @@ parseconfcolor(uint8_t asop, const char *selector, const char *value, int flags,
 	return (0);
 }
 
+static int
+setconfbarsource(uint8_t asop, const char *selector, const char *value,
+    int flags, char **emsg)
+{
+	struct bar_source	*bs;
+	const char		*errstr;
+	char			*cmd;
+	int			interval = 0;
+
+	if (selector == NULL || strlen(selector) == 0) {
+		ALLOCSTR(emsg, "missing selector");
+		return (1);
+	}
+	if (strlen(selector) >= SWM_BAR_KEY_MAX ||
+	    strcspn(selector, "{}+= \t") < strlen(selector)) {
+		ALLOCSTR(emsg, "invalid source name");
+		return (1);
+	}
+
+	if (asopcheck(asop, SWM_ASOP_BASIC, emsg))
+		return (1);
+
+	if (flags == SWM_BAR_SOURCE_INTERVAL) {
+		interval = strtonum(value, 0, 86400, &errstr);
+		if (errstr) {
+			ALLOCSTR(emsg, "interval is %s: %s", errstr, value);
+			return (1);
+		}
+	}
+
+	if ((bs = bar_source_find(selector)) == NULL) {
+		if ((bs = calloc(1, sizeof *bs)) == NULL)
+			err(1, "setconfbarsource: calloc");
+		strlcpy(bs->name, selector, sizeof bs->name);
+		bs->fd = -1;
+		bs->backoff = SWM_BAR_SOURCE_BACKOFF_MIN;
+		TAILQ_INSERT_TAIL(&bar_sources, bs, entry);
+		bar_source_count++;
+	}
+	bs->configured = true;
+
+	if (flags == SWM_BAR_SOURCE_INTERVAL) {
+		bs->interval = interval;
+		return (0);
+	}
+
+	cmd = expand_tilde(value);
+	if (bs->cmd && strcmp(bs->cmd, cmd) == 0) {
+		/* Leave a running source alone. */
+		free(cmd);
+		return (0);
+	}
+
+	DNPRINTF(SWM_D_CONF, "[%s] %s\n", bs->name, cmd);
+
+	bar_source_stop(bs);
+	free(bs->cmd);
+	bs->cmd = cmd;
+	bs->backoff = SWM_BAR_SOURCE_BACKOFF_MIN;
+	bs->next.tv_sec = bs->next.tv_nsec = 0;
+
+	return (0);
+}
+
 static int
 setconfcolor(uint8_t asop, const char *selector, const char *value, int flags,
     char **emsg)
@@ -14811,6 +17301,7 @@ struct config_option configopt[] = {
 	{ "autorun",			setautorun,	0 },
 	{ "bar_action",			setconfvalue,	SWM_S_BAR_ACTION },
 	{ "bar_action_expand",		setconfvalue,	SWM_S_BAR_ACTION_EXPAND },
+	{ "bar_action_keyed",		setconfvalue,	SWM_S_BAR_ACTION_KEYED },
 	{ "bar_at_bottom",		setconfvalue,	SWM_S_BAR_AT_BOTTOM },
 	{ "bar_border",			setconfcolor,	SWM_S_COLOR_BAR_BORDER },
 	{ "bar_border_unfocus",		setconfcolor,	SWM_S_COLOR_BAR_BORDER_UNFOCUS },
@@ -14833,6 +17324,8 @@ struct config_option configopt[] = {
 	{ "bar_justify",		setconfvalue,	SWM_S_BAR_JUSTIFY },
 	{ "bar_padding_horizontal",	setconfvalue,	SWM_S_BAR_PADDING_HORIZONTAL },
 	{ "bar_padding_vertical",	setconfvalue,	SWM_S_BAR_PADDING_VERTICAL },
+	{ "bar_source",			setconfbarsource,SWM_BAR_SOURCE_CMD },
+	{ "bar_source_interval",	setconfbarsource,SWM_BAR_SOURCE_INTERVAL },
 	{ "bar_workspace_limit",	setconfvalue,	SWM_S_BAR_WORKSPACE_LIMIT },
 	{ "bind",			setconfbinding,	0 },
 	{ "border_width",		setconfvalue,	SWM_S_BORDER_WIDTH },
@@ -14908,6 +17401,7 @@ struct config_option configopt[] = {
 	{ "workspace_clamp",		setconfvalue,	SWM_S_WORKSPACE_CLAMP },
 	{ "workspace_limit",		setconfvalue,	SWM_S_WORKSPACE_LIMIT },
 	{ "workspace_indicator",	setconfvalue,	SWM_S_WORKSPACE_INDICATOR },
+	{ "workspace_park",		setconfvalue,	SWM_S_WORKSPACE_PARK },
 	{ "name",			setconfvalue,	SWM_S_WORKSPACE_NAME },
 	{ "focus_mark_none",		setconfvalue,	SWM_S_FOCUS_MARK_NONE },
 	{ "focus_mark_normal",		setconfvalue,	SWM_S_FOCUS_MARK_NORMAL },
@@ -14935,36 +17429,226 @@ struct config_option configopt[] = {
 };
 
 static void
-_add_startup_exception(const char *fmt, va_list ap)
+_add_startup_exception(const char *fmt, va_list ap)
+{
+	if (vasprintf(&startup_exception, fmt, ap) == -1)
+		warn("%s: asprintf", __func__);
+}
+
+static void
+add_startup_exception(const char *fmt, ...)
+{
+	va_list ap;
+
+	nr_exceptions++;
+
+	if (startup_exception)
+		return;
+
+	/* force bar to be enabled due to exception */
+	bar_enabled = true;
+
+	va_start(ap, fmt);
+	_add_startup_exception(fmt, ap);
+	va_end(ap);
+}
+
+static void
+clear_startup_exceptions(void)
+{
+	free(startup_exception);
+	startup_exception = NULL;
+	nr_exceptions = 0;
+}
+
+static void
+conf_watch_add(const char *filename)
+{
+#ifdef SWM_INOTIFY
+	struct conf_watch	*cw;
+	const char		*name;
+	char			*dir;
+	int			wd;
+
+	if (conf_notify_fd == -1 &&
+	    (conf_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+		warn("conf_watch_add: inotify_init1");
+		return;
+	}
+
+	/* Watch the directory so files replaced by rename are seen. */
+	if ((name = strrchr(filename, '/')) != NULL) {
+		if ((dir = strndup(filename, name == filename ? 1 :
+		    (size_t)(name - filename))) == NULL)
+			err(1, "conf_watch_add: strndup");
+		name++;
+	} else {
+		if ((dir = strdup(".")) == NULL)
+			err(1, "conf_watch_add: strdup");
+		name = filename;
+	}
+
+	wd = inotify_add_watch(conf_notify_fd, dir, IN_CLOSE_WRITE |
+	    IN_MOVED_TO | IN_CREATE);
+	if (wd == -1) {
+		DNPRINTF(SWM_D_CONF, "%s: %s\n", dir, strerror(errno));
+		free(dir);
+		return;
+	}
+	free(dir);
+
+	SLIST_FOREACH(cw, &conf_watches, entry)
+		if (cw->wd == wd && strcmp(cw->name, name) == 0)
+			return;
+
+	if ((cw = calloc(1, sizeof *cw)) == NULL)
+		err(1, "conf_watch_add: calloc");
+	if ((cw->name = strdup(name)) == NULL)
+		err(1, "conf_watch_add: strdup");
+	cw->wd = wd;
+	SLIST_INSERT_HEAD(&conf_watches, cw, entry);
+
+	DNPRINTF(SWM_D_CONF, "wd: %d, name: %s\n", wd, name);
+#else
+	(void)filename;
+#endif
+}
+
+static void
+conf_watch_clear(void)
 {
-	if (vasprintf(&startup_exception, fmt, ap) == -1)
-		warn("%s: asprintf", __func__);
+	struct conf_watch	*cw;
+
+	while ((cw = SLIST_FIRST(&conf_watches))) {
+		SLIST_REMOVE_HEAD(&conf_watches, entry);
+#ifdef SWM_INOTIFY
+		/* Directories may be shared; later removals just fail. */
+		inotify_rm_watch(conf_notify_fd, cw->wd);
+#endif
+		free(cw->name);
+		free(cw);
+	}
 }
 
+/* Drain pending notifications and (re)arm the settle deadline. */
 static void
-add_startup_exception(const char *fmt, ...)
+conf_watch_read(void)
 {
-	va_list ap;
+#ifdef SWM_INOTIFY
+	struct inotify_event	*ev;
+	struct conf_watch	*cw;
+	uint32_t		buf[1024];	/* Aligned for events. */
+	ssize_t			len;
+	char			*p;
+	bool			hit = false;
 
-	nr_exceptions++;
+	while ((len = read(conf_notify_fd, buf, sizeof buf)) > 0)
+		for (p = (char *)buf; p < (char *)buf + len;
+		    p += sizeof(struct inotify_event) + ev->len) {
+			ev = (struct inotify_event *)p;
+			if (ev->len == 0)
+				continue;
+			SLIST_FOREACH(cw, &conf_watches, entry)
+				if (cw->wd == ev->wd &&
+				    strcmp(cw->name, ev->name) == 0) {
+					hit = true;
+					break;
+				}
+		}
 
-	if (startup_exception)
-		return;
+	if (hit) {
+		clock_gettime(CLOCK_MONOTONIC, &conf_settle);
+		conf_settle.tv_nsec += SWM_CONF_SETTLE_MS * 1000000L;
+		conf_settle.tv_sec += conf_settle.tv_nsec / 1000000000L;
+		conf_settle.tv_nsec %= 1000000000L;
+		DNPRINTF(SWM_D_CONF, "config changed, settling\n");
+	}
+#endif
+}
 
-	/* force bar to be enabled due to exception */
-	bar_enabled = true;
+/* Milliseconds until the settle deadline, capped to timeout. */
+static int
+conf_watch_timeout(int timeout)
+{
+	struct timespec		now;
+	long			ms;
 
-	va_start(ap, fmt);
-	_add_startup_exception(fmt, ap);
-	va_end(ap);
+	if (conf_settle.tv_sec == 0 && conf_settle.tv_nsec == 0)
+		return (timeout);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (conf_settle.tv_sec - now.tv_sec) * 1000 +
+	    (conf_settle.tv_nsec - now.tv_nsec) / 1000000;
+	if (ms < 0)
+		ms = 0;
+
+	return (ms < timeout ? (int)ms : timeout);
 }
 
-static void
-clear_startup_exceptions(void)
+/* Whether writes have settled and a reload is due. */
+static bool
+conf_watch_settled(void)
 {
-	free(startup_exception);
-	startup_exception = NULL;
-	nr_exceptions = 0;
+	if (conf_settle.tv_sec == 0 && conf_settle.tv_nsec == 0)
+		return (false);
+
+	if (conf_watch_timeout(1) > 0)
+		return (false);
+
+	conf_settle.tv_sec = 0;
+	conf_settle.tv_nsec = 0;
+	return (true);
+}
+
+/* FNV-1a, including the terminating NUL as a field separator. */
+static uint32_t
+conf_hash(uint32_t h, const char *str)
+{
+	if (h == 0)
+		h = 2166136261u;
+
+	do {
+		h ^= (unsigned char)*str;
+		h *= 16777619u;
+	} while (*str++ != '\0');
+
+	return (h);
+}
+
+/* Subsystem that has to be refreshed when a setting changes. */
+static int
+conf_reload_class(int optidx)
+{
+	struct config_option	*opt = &configopt[optidx];
+
+	if (opt->func == setconfcolor || opt->func == setconfcolorlist)
+		return (SWM_RELOAD_COLORS);
+	if (opt->func == setconfquirk)
+		return (SWM_RELOAD_QUIRKS);
+	if (opt->func == setconfbarsource)
+		return (SWM_RELOAD_SOURCES);
+	if (opt->func == setconfbinding || opt->func == setconfcancelkey ||
+	    opt->func == setconfmodkey || opt->func == setkeymapping ||
+	    opt->func == setconfspawn || opt->func == setconfspawnflags)
+		return (SWM_RELOAD_BINDINGS);
+	if (opt->func != setconfvalue)
+		return (SWM_RELOAD_LAYOUT);
+
+	switch (opt->flags) {
+	case SWM_S_BAR_ACTION:
+	case SWM_S_BAR_ACTION_KEYED:
+		return (SWM_RELOAD_STATUS);
+	case SWM_S_BAR_AT_BOTTOM:
+	case SWM_S_BAR_BORDER_WIDTH:
+	case SWM_S_BAR_ENABLED:
+	case SWM_S_BAR_FONT:
+	case SWM_S_BAR_FONT_PUA:
+	case SWM_S_BAR_PADDING_HORIZONTAL:
+	case SWM_S_BAR_PADDING_VERTICAL:
+		return (SWM_RELOAD_BAR);
+	default:
+		return (SWM_RELOAD_LAYOUT);
+	}
 }
 
 static int
@@ -14977,6 +17661,7 @@ conf_load(const char *filename, int keymapping)
 	size_t			linelen, lineno = 0;
 	int			wordlen, i, optidx, count;
 	uint8_t			asop = 0;
+	uint32_t		*sig;
 
 	DNPRINTF(SWM_D_CONF, "filename: %s, keymapping: %d\n", filename,
 	    keymapping);
@@ -14986,6 +17671,8 @@ conf_load(const char *filename, int keymapping)
 		return (1);
 	}
 
+	conf_watch_add(filename);
+
 	DNPRINTF(SWM_D_CONF, "open %s\n", filename);
 
 	if ((config = fopen(filename, "r")) == NULL) {
@@ -15096,6 +17783,14 @@ conf_load(const char *filename, int keymapping)
 		while (ce > optval && isspace((unsigned char)*ce))
 			--ce;
 		*(ce + 1) = '\0';
+
+		/* Record setting in the signature of its subsystem. */
+		sig = &conf_sig[conf_reload_class(optidx)];
+		*sig = conf_hash(*sig, opt->name);
+		*sig = conf_hash(*sig, optsub ? optsub : "");
+		*sig = conf_hash(*sig, asop == SWM_ASOP_ADD ? "+" :
+		    (asop == SWM_ASOP_SUBTRACT ? "-" : "="));
+		*sig = conf_hash(*sig, optval);
 		/* call function to deal with it all */
 		if (opt->func &&
 		    opt->func(asop, optsub, optval, opt->flags, &emsg)) {
@@ -15301,6 +17996,7 @@ unparent_window(struct ws_win *win)
 		win->debug = XCB_WINDOW_NONE;
 	}
 
+	search_win_detach(win);
 	xcb_destroy_window(conn, win->frame);
 	win->frame = XCB_WINDOW_NONE;
 }
@@ -15418,6 +18114,10 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 	win->mapping = 0;
 	win->unmapping = 0;
 	win->strut = NULL;
+	SLIST_INIT(&win->subwins);
+	TAILQ_INIT(&win->children);
+	TAILQ_INIT(&win->dependents);
+	TAILQ_INIT(&win->redirects);
 	win->main = win;
 	win->parent = NULL;
 
@@ -15438,7 +18138,7 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 
 	/* Get WM_TRANSIENT_FOR/update parent. */
 	if (get_wm_transient_for(win))
-		win->main = find_main_window(win);
+		win_set_main(win, find_main_window(win));
 
 	/* Only updates other wins (not in list yet.) */
 	update_win_refs(win);
@@ -15593,6 +18293,7 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 	case SWM_STACK_BELOW:
 		TAILQ_INSERT_HEAD(&win->ws->winlist, win, entry);
 	}
+	win_count_update(win);
 
 	/* The most recent focus, after current focus. */
 	if (s->focus && (w = TAILQ_FIRST(&s->fl)))
@@ -15606,7 +18307,7 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 	else
 		TAILQ_INSERT_HEAD(&s->priority, win, priority_entry);
 
-	ewmh_update_client_list(s);
+	ewmh_client_list_add(win);
 
 	/* Get/apply initial _NET_WM_STATE */
 	ewmh_get_wm_state(win);
@@ -15765,6 +18466,7 @@ free_window(struct ws_win *win)
 		return;
 
 	xcb_icccm_get_wm_class_reply_wipe(&win->ch);
+	clear_subwins(win);
 
 	/* paint memory */
 	memset(win, 0xff, sizeof *win);	/* XXX kill later */
@@ -15785,6 +18487,7 @@ unmanage_window(struct ws_win *win)
 	unparent_window(win);
 
 	TAILQ_REMOVE(&win->ws->winlist, win, entry);
+	win_count_remove(win);
 	TAILQ_REMOVE(&win->s->fl, win, focus_entry);
 	TAILQ_REMOVE(&win->s->priority, win, priority_entry);
 	TAILQ_REMOVE(&win->s->managed, win, manage_entry);
@@ -15873,6 +18576,10 @@ get_event_label(xcb_generic_event_t *e)
 #endif
 	    ))
 		label = get_randr_event_label(e);
+#ifdef SWM_XCB_HAS_XKB
+	else if (xkb_support && type == xkb_eventbase)
+		label = "XkbEvent";
+#endif
 	else
 		label = "Unknown Event";
 
@@ -15892,7 +18599,13 @@ expose(xcb_expose_event_t *e)
 		return;
 
 	if ((b = find_bar(e->window))) {
-		bar_draw(b);
+		/* Contents are unchanged; just repaint from the buffer. */
+		if (b->drawn && !b->dirty)
+			xcb_copy_area(conn, b->buffer, b->id, b->gc, 0, 0, 0, 0,
+			    WIDTH(b) + 2 * bar_border_width,
+			    HEIGHT(b) + 2 * bar_border_width);
+		else
+			bar_draw(b);
 		xcb_flush(conn);
 	} else if ((w = find_win_frame(e->window))) {
 		draw_frame(w);
@@ -15987,25 +18700,25 @@ keypress(xcb_key_press_event_t *e)
 {
 	struct action		*ap;
 	struct binding		*bp;
-	xcb_keysym_t		keysym;
 	bool			replay = true;
 
 	event_time = e->time;
 
-	keysym = xcb_key_press_lookup_keysym(syms, e, 0);
+	/* Apply mapping changes queued earlier in this event batch. */
+	keymap_refresh();
+	if (!key_dispatch_valid)
+		key_dispatch_build();
 
 	DNPRINTF(SWM_D_EVENT, "keysym: %u, win (x,y): %#x (%d,%d), detail: %u, "
 	    "time: %#x, root (x,y): %#x (%d,%d), child: %#x, state: %u, "
-	    "cleaned: %u, same_screen: %s\n", keysym, e->event, e->event_x,
+	    "cleaned: %u, same_screen: %s\n",
+	    xcb_key_press_lookup_keysym(syms, e, 0), e->event, e->event_x,
 	    e->event_y, e->detail, e->time, e->root, e->root_x, e->root_y,
 	    e->child, e->state, CLEANMASK(e->state), YESNO(e->same_screen));
 
-	bp = binding_lookup(CLEANMASK(e->state), KEYBIND, keysym);
-	if (bp == NULL) {
-		/* Look for catch-all. */
-		if ((bp = binding_lookup(ANYMOD, KEYBIND, keysym)) == NULL)
-			goto out;
-	}
+	if (key_dispatch[e->detail] == NULL ||
+	    (bp = key_dispatch[e->detail][CLEANMASK(e->state)]) == NULL)
+		goto out;
 
 	replay = bp->flags & BINDING_F_REPLAY;
 
@@ -16038,23 +18751,22 @@ static void
 keyrelease(xcb_key_release_event_t *e)
 {
 	struct action		*ap;
-	struct binding		*bp;
-	xcb_keysym_t		keysym;
+	struct binding		*bp = NULL;
 
 	event_time = e->time;
 
-	keysym = xcb_key_release_lookup_keysym(syms, e, 0);
+	keymap_refresh();
+	if (!key_dispatch_valid)
+		key_dispatch_build();
 
 	DNPRINTF(SWM_D_EVENT, "keysym: %u, win (x,y): %#x (%d,%d), detail: %u, "
 	    "time: %#x, root (x,y): %#x (%d,%d), child: %#x, state: %u, "
-	    "same_screen: %s\n", keysym, e->event, e->event_x, e->event_y,
-	    e->detail, e->time, e->root, e->root_x, e->root_y, e->child,
-	    e->state, YESNO(e->same_screen));
+	    "same_screen: %s\n", xcb_key_release_lookup_keysym(syms, e, 0),
+	    e->event, e->event_x, e->event_y, e->detail, e->time, e->root,
+	    e->root_x, e->root_y, e->child, e->state, YESNO(e->same_screen));
 
-	bp = binding_lookup(CLEANMASK(e->state), KEYBIND, keysym);
-	if (bp == NULL)
-		/* Look for catch-all. */
-		bp = binding_lookup(ANYMOD, KEYBIND, keysym);
+	if (key_dispatch[e->detail])
+		bp = key_dispatch[e->detail][CLEANMASK(e->state)];
 
 	if (bp && (ap = &actions[bp->action]) && !(ap->flags & FN_F_NOREPLAY) &&
 	    bp->flags & BINDING_F_REPLAY) {
@@ -16114,10 +18826,15 @@ buttonpress(xcb_button_press_event_t *e)
 	if ((ap = &actions[bp->action]) == NULL)
 		goto out;
 
+	press_pos.valid = true;
+	press_pos.root = e->root;
+	press_pos.x = e->root_x;
+	press_pos.y = e->root_y;
 	if (bp->action == FN_SPAWN_CUSTOM)
 		spawn_custom(find_screen(e->root), &ap->args, bp->spawn_name);
 	else if (ap->func)
 		ap->func(find_screen(e->root), bp, &ap->args);
+	press_pos.valid = false;
 
 	replay = replay && !(ap->flags & FN_F_NOREPLAY);
 out:
@@ -16404,6 +19121,8 @@ destroynotify(xcb_destroy_notify_event_t *e)
 
 	DNPRINTF(SWM_D_EVENT, "win %#x\n", e->window);
 
+	subwin_invalidate(e->window);
+
 	if ((win = find_win(e->window)) == NULL) {
 		DNPRINTF(SWM_D_EVENT, "ignore; unmanaged.\n");
 		return;
@@ -16422,7 +19141,7 @@ destroynotify(xcb_destroy_notify_event_t *e)
 	follow = follow_pointer(s, SWM_FOCUS_TYPE_UNMAP);
 
 	if (win == ws->focus)
-		ws->focus = get_focus_magic(get_focus_other(win));
+		ws_set_focus(ws, get_focus_magic(get_focus_other(win)));
 
 	unmanage_window(win);
 
@@ -16597,6 +19316,7 @@ enternotify(xcb_enter_notify_event_t *e)
 
 	event_time = e->time;
 	pointer_window = e->event;
+	pointer_cache.valid = false;
 
 	DNPRINTF(SWM_D_FOCUS, "time: %#x, win (x,y): %#x (%d,%d), mode: %s(%d),"
 	    " detail: %s(%d), root (x,y): %#x (%d,%d), child: %#x, "
@@ -16725,15 +19445,73 @@ mappingnotify(xcb_mapping_notify_event_t *e)
 	    "count: %u\n", get_mapping_notify_label(e->request), e->request,
 	    e->first_keycode, e->count);
 
-	if (e->request != XCB_MAPPING_POINTER) {
-		xcb_refresh_keyboard_mapping(syms, e);
-		grabkeys();
-	}
+	/* Keyboard changes are coalesced and applied before blocking. */
+	if (e->request == XCB_MAPPING_POINTER)
+		grabbuttons();
+	else if (xkb_support)
+		DNPRINTF(SWM_D_EVENT, "handled by XKB\n");
+	else if (e->request == XCB_MAPPING_KEYBOARD)
+		keymap_pending |= SWM_KEYMAP_SYMS;
+	else if (e->request == XCB_MAPPING_MODIFIER)
+		keymap_pending |= SWM_KEYMAP_MODS;
 
-	grabbuttons();
 	DNPRINTF(SWM_D_EVENT, "done\n");
 }
 
+#ifdef SWM_XCB_HAS_XKB
+static void
+xkbevent(xcb_generic_event_t *evt)
+{
+	xcb_xkb_new_keyboard_notify_event_t	*nkn;
+	xcb_xkb_map_notify_event_t		*mn;
+
+	switch (((xcb_xkb_map_notify_event_t *)evt)->xkbType) {
+	case XCB_XKB_NEW_KEYBOARD_NOTIFY:
+		nkn = (xcb_xkb_new_keyboard_notify_event_t *)evt;
+		DNPRINTF(SWM_D_EVENT, "NewKeyboardNotify, changed: %#x\n",
+		    nkn->changed);
+		/* A new device may bring its own keymap in any keycode range. */
+		keymap_pending |= SWM_KEYMAP_SYMS | SWM_KEYMAP_MODS;
+		break;
+	case XCB_XKB_MAP_NOTIFY:
+		mn = (xcb_xkb_map_notify_event_t *)evt;
+		DNPRINTF(SWM_D_EVENT, "MapNotify, changed: %#x\n",
+		    mn->changed);
+		if (mn->changed & XCB_XKB_MAP_PART_KEY_SYMS)
+			keymap_pending |= SWM_KEYMAP_SYMS;
+		if (mn->changed & XCB_XKB_MAP_PART_MODIFIER_MAP)
+			keymap_pending |= SWM_KEYMAP_MODS;
+		break;
+	}
+}
+#endif /* SWM_XCB_HAS_XKB */
+
+/* Apply a batch of keyboard mapping changes. */
+static void
+keymap_refresh(void)
+{
+	uint32_t		pending = keymap_pending;
+
+	if (pending == 0)
+		return;
+	keymap_pending = 0;
+
+	DNPRINTF(SWM_D_MISC, "pending: %#x\n", pending);
+
+	if (pending & SWM_KEYMAP_SYMS) {
+		xcb_key_symbols_free(syms);
+		if ((syms = xcb_key_symbols_alloc(conn)) == NULL)
+			errx(1, "unable to allocate key symbols.");
+		keysyms_per_keycode = 0;
+	}
+	if (pending & SWM_KEYMAP_MODS)
+		numlockmask_valid = false;
+
+	grabkeys();
+	if (pending & SWM_KEYMAP_MODS)
+		grabbuttons();
+}
+
 static void
 click_focus(struct swm_screen *s, xcb_window_t id, int x, int y)
 {
@@ -16760,7 +19538,7 @@ click_focus(struct swm_screen *s, xcb_window_t id, int x, int y)
 		w = get_focus_magic(win);
 		if (w != win && w == win->ws->focus &&
 		    win->focus_redirect == win)
-			win->focus_redirect = NULL;
+			win_set_focus_redirect(win, NULL);
 		focus_win(s, win);
 		if (click_to_raise && !win_prioritized(win)) {
 			prioritize_window(win);
@@ -16942,6 +19720,7 @@ motionnotify(xcb_motion_notify_event_t *e)
 	struct ws_win		*win = NULL;
 
 	event_time = e->time;
+	pointer_cache.valid = false;
 
 	DNPRINTF(SWM_D_FOCUS, "time: %#x, win (x,y): %#x (%d,%d), "
 	    "detail: %s(%d), root (x,y): %#x (%d,%d), child: %#x, "
@@ -16962,10 +19741,7 @@ motionnotify(xcb_motion_notify_event_t *e)
 		if (pointer_window != XCB_WINDOW_NONE)
 			focus_window_region(pointer_window);
 		else if ((s = find_screen(e->root)) != NULL) {
-			TAILQ_FOREACH(r, &s->rl, entry)
-				if (X(r) <= e->root_x && e->root_x < MAX_X(r) &&
-				    Y(r) <= e->root_y && e->root_y < MAX_Y(r))
-					break;
+			r = region_under(s, e->root_x, e->root_y);
 			focus_region(r);
 		}
 	}
@@ -16990,6 +19766,8 @@ propertynotify(xcb_property_notify_event_t *e)
 		if (e->atom == ewmh[_NET_DESKTOP_NAMES].atom) {
 			s = find_screen(e->window);
 			if (s) {
+				/* May have been set by another client. */
+				ewmh_root_prop_clear(s, _NET_DESKTOP_NAMES);
 				ewmh_get_desktop_names(s);
 				update_bars(s);
 			}
@@ -17035,6 +19813,8 @@ reparentnotify(xcb_reparent_notify_event_t *e)
 	DNPRINTF(SWM_D_EVENT, "event: %#x, win %#x, parent: %#x, "
 	    "(x,y): (%u,%u), override_redirect: %u\n", e->event, e->window,
 	    e->parent, e->x, e->y, e->override_redirect);
+
+	subwin_invalidate(e->window);
 }
 
 static void
@@ -17634,7 +20414,7 @@ get_randr_rotation_label(int rot)
 	return (label);
 }
 
-static void
+static struct swm_region *
 new_region(struct swm_screen *s, int16_t x, int16_t y, uint16_t w, uint16_t h,
     uint16_t rot)
 {
@@ -17656,13 +20436,7 @@ new_region(struct swm_screen *s, int16_t x, int16_t y, uint16_t w, uint16_t h,
 			if (r->ws->r != NULL)
 				r->ws->old_r = r->ws->r;
 			r->ws->r = NULL;
-			free_stackable(r->st);
-			r->st = NULL;
-			bar_cleanup(r);
-			xcb_destroy_window(conn, r->id);
-			r->id = XCB_WINDOW_NONE;
-			TAILQ_REMOVE(&s->rl, r, entry);
-			TAILQ_INSERT_TAIL(&s->orl, r, entry);
+			remove_region(r);
 		}
 	}
 
@@ -17724,9 +20498,11 @@ new_region(struct swm_screen *s, int16_t x, int16_t y, uint16_t w, uint16_t h,
 	r->s = s;
 	r->ws = ws;
 	r->ws_prior = NULL;
+	r->randr_id = XCB_NONE;
 	ws->r = r;
 	outputs++;
 	TAILQ_INSERT_TAIL(&s->rl, r, entry);
+	s->ri.valid = false;
 
 	if (workspace_autorotate)
 		rotatews(ws, rot);
@@ -17750,87 +20526,239 @@ new_region(struct swm_screen *s, int16_t x, int16_t y, uint16_t w, uint16_t h,
 	xcb_configure_window(conn, r->id, XCB_CONFIG_WINDOW_STACK_MODE, wa);
 
 	xcb_map_window(conn, r->id);
+
+	return (r);
+}
+
+/* Retire an active region to the old region list. */
+static void
+remove_region(struct swm_region *r)
+{
+	struct swm_screen	*s = r->s;
+
+	DNPRINTF(SWM_D_MISC, "screen[%d]:%dx%d+%d+%d, randr_id: %#x\n",
+	    s->idx, WIDTH(r), HEIGHT(r), X(r), Y(r), r->randr_id);
+
+	free_stackable(r->st);
+	r->st = NULL;
+	bar_cleanup(r);
+	xcb_destroy_window(conn, r->id);
+	r->id = XCB_WINDOW_NONE;
+	TAILQ_REMOVE(&s->rl, r, entry);
+	TAILQ_INSERT_TAIL(&s->orl, r, entry);
+	s->ri.valid = false;
+	outputs--;
 }
 
+/* Move/resize a region, and its bar, in place. */
 static void
+update_region_geometry(struct swm_region *r, struct swm_geometry *g)
+{
+	uint32_t		wa[4];
+	bool			resized;
+
+	DNPRINTF(SWM_D_MISC, "screen[%d]:%dx%d+%d+%d -> %dx%d+%d+%d,%s\n",
+	    r->s->idx, WIDTH(r), HEIGHT(r), X(r), Y(r), g->w, g->h, g->x, g->y,
+	    get_randr_rotation_label(g->r));
+
+	if (workspace_autorotate && ROTATION(r) != g->r)
+		rotatews(r->ws, g->r);
+
+	r->g = *g;
+	r->g_usable = r->g;
+	r->s->ri.valid = false;
+
+	wa[0] = X(r);
+	wa[1] = Y(r);
+	wa[2] = WIDTH(r);
+	wa[3] = HEIGHT(r);
+	xcb_configure_window(conn, r->id, XCB_CONFIG_WINDOW_X |
+	    XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH |
+	    XCB_CONFIG_WINDOW_HEIGHT, wa);
+
+	if (r->bar == NULL)
+		return;
+
+	resized = (WIDTH(r->bar) != WIDTH(r) - 2 * bar_border_width);
+	bar_set_geometry(r);
+
+	wa[0] = X(r->bar) - bar_border_width;
+	wa[1] = Y(r->bar) - bar_border_width;
+	wa[2] = WIDTH(r->bar) + 2 * bar_border_width;
+	wa[3] = HEIGHT(r->bar) + 2 * bar_border_width;
+	xcb_configure_window(conn, r->bar->id, XCB_CONFIG_WINDOW_X |
+	    XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH |
+	    XCB_CONFIG_WINDOW_HEIGHT, wa);
+
+	if (resized) {
+		xcb_free_pixmap(conn, r->bar->buffer);
+		xcb_create_pixmap(conn, r->s->depth, r->bar->buffer,
+		    r->bar->id, wa[2], wa[3]);
+		/* Rebind the Render picture to the new buffer. */
+		if (r->bar->xft_draw)
+			XftDrawChange(r->bar->xft_draw, r->bar->buffer);
+		r->bar->drawn = false;
+	}
+	bar_draw(r->bar);
+}
+
+/*
+ * Reconcile the screen's regions with the current RandR monitors (1.5) or
+ * CRTCs. Regions whose monitor/CRTC persists are kept (and moved in place if
+ * needed); only regions for removed or added ones are destroyed or created.
+ * Returns true if anything changed.
+ */
+static bool
 scan_randr(struct swm_screen *s)
 {
 #ifdef XCB_RANDR_GET_SCREEN_RESOURCES_CURRENT /* RandR 1.3 */
-	int						i, j;
-	int						ncrtc = 0, nmodes = 0;
+	int						j, nmodes = 0;
 	xcb_randr_get_screen_resources_current_reply_t	*srr;
-	xcb_randr_get_crtc_info_reply_t			*cir = NULL;
+	xcb_randr_get_crtc_info_cookie_t		*circ = NULL;
+	xcb_randr_get_crtc_info_reply_t			**cirs = NULL, *cir;
 	xcb_randr_crtc_t				*crtc;
 	xcb_randr_mode_info_t				*mode;
 	int						minrate, currate;
 #endif
-	struct swm_region				*r;
+#ifdef XCB_RANDR_GET_MONITORS /* RandR 1.5 */
+	xcb_randr_get_monitors_cookie_t			gmc;
+	xcb_randr_get_monitors_reply_t			*gmr = NULL;
+	xcb_randr_monitor_info_iterator_t		mii;
+#endif
+	struct swm_region				*r, *rn;
+	struct swm_region_spec				*specs, *sp;
 	xcb_screen_t					*screen;
+	int						i, k, ncrtc = 0, nspecs = 0;
+	int						nmon = 0;
+	bool						changed = false;
 
 	if (s == NULL)
-		return;
+		return (false);
 
 	DNPRINTF(SWM_D_MISC, "screen: %d\n", s->idx);
 
 	if ((screen = get_screen(s->idx)) == NULL)
 		errx(1, "ERROR: unable to get screen %d.", s->idx);
 
-	/* Cleanup references. */
-	clear_stack(s);
-
-	/* remove any old regions */
-	while ((r = TAILQ_FIRST(&s->rl)) != NULL) {
-		r->ws->old_r = r->ws->r = NULL;
-		free_stackable(r->st);
-		r->st = NULL;
-		bar_cleanup(r);
-		xcb_destroy_window(conn, r->id);
-		r->id = XCB_WINDOW_NONE;
-		TAILQ_REMOVE(&s->rl, r, entry);
-		TAILQ_INSERT_TAIL(&s->orl, r, entry);
-	}
-	outputs = 0;
-
 	/* Update root region geometry. */
 	s->r->g.w = screen->width_in_pixels;
 	s->r->g.h = screen->height_in_pixels;
 
 #ifdef XCB_RANDR_GET_SCREEN_RESOURCES_CURRENT
-	/* Try to automatically detect regions based on RandR CRTC info. */
+	/* Try to automatically detect regions based on RandR info. */
+	srr = NULL;
 	if (randr_scan) {
+		/* Monitors and screen resources are requested together. */
+#ifdef XCB_RANDR_GET_MONITORS
+		if (randr_monitors)
+			gmc = xcb_randr_get_monitors(conn, s->root, 1);
+#endif
 		srr = xcb_randr_get_screen_resources_current_reply(conn,
 		    xcb_randr_get_screen_resources_current(conn, s->root),
 		    NULL);
-		if (srr == NULL) {
-			new_region(s, 0, 0, screen->width_in_pixels,
-			    screen->height_in_pixels, ROTATION_DEFAULT);
-			goto out;
-		} else {
+		if (srr) {
 			ncrtc = srr->num_crtcs;
 			nmodes = srr->num_modes;
 		}
+#ifdef XCB_RANDR_GET_MONITORS
+		if (randr_monitors) {
+			gmr = xcb_randr_get_monitors_reply(conn, gmc, NULL);
+			if (gmr)
+				nmon = gmr->nMonitors;
+		}
+#endif
+	}
+
+	/* Send every CRTC query before waiting on any of the replies. */
+	if (ncrtc > 0) {
+		if ((circ = calloc(ncrtc, sizeof *circ)) == NULL ||
+		    (cirs = calloc(ncrtc, sizeof *cirs)) == NULL)
+			err(1, "scan_randr: calloc");
+
+		crtc = xcb_randr_get_screen_resources_current_crtcs(srr);
+		for (i = 0; i < ncrtc; i++)
+			circ[i] = xcb_randr_get_crtc_info(conn, crtc[i],
+			    XCB_CURRENT_TIME);
+		for (i = 0; i < ncrtc; i++)
+			cirs[i] = xcb_randr_get_crtc_info_reply(conn, circ[i],
+			    NULL);
+		free(circ);
+	}
+#endif
+
+	/* Room for every CRTC or monitor plus the full screen fallback. */
+	if ((specs = calloc(ncrtc + nmon + 1, sizeof *specs)) == NULL)
+		err(1, "scan_randr: calloc");
+
+#ifdef XCB_RANDR_GET_MONITORS
+	/* Logical monitors, including user-defined splits, take priority. */
+	if (gmr) {
+		mii = xcb_randr_get_monitors_monitors_iterator(gmr);
+		for (; mii.rem; xcb_randr_monitor_info_next(&mii)) {
+			if (mii.data->width == 0 || mii.data->height == 0)
+				continue;
+
+			sp = &specs[nspecs++];
+			sp->randr_id = mii.data->name;
+			sp->g.x = mii.data->x;
+			sp->g.y = mii.data->y;
+			sp->g.w = mii.data->width;
+			sp->g.h = mii.data->height;
+			sp->g.r = ROTATION_DEFAULT;
+
+			/* Monitors carry no rotation; take it from the CRTC. */
+			for (k = 0; k < ncrtc; k++) {
+				cir = cirs[k];
+				if (cir && cir->mode && cir->x == sp->g.x &&
+				    cir->y == sp->g.y &&
+				    cir->width == sp->g.w &&
+				    cir->height == sp->g.h) {
+					sp->g.r = cir->rotation & 0xf;
+					break;
+				}
+			}
+		}
+		free(gmr);
+	}
+#endif
 
+#ifdef XCB_RANDR_GET_SCREEN_RESOURCES_CURRENT
+	if (srr) {
 		minrate = -1;
 		mode = xcb_randr_get_screen_resources_current_modes(srr);
 		crtc = xcb_randr_get_screen_resources_current_crtcs(srr);
+		/* Only use CRTCs for regions if there were no monitors. */
+		k = nspecs;
 		for (i = 0; i < ncrtc; i++) {
 			currate = SWM_RATE_DEFAULT;
-			cir = xcb_randr_get_crtc_info_reply(conn,
-			    xcb_randr_get_crtc_info(conn, crtc[i],
-			    XCB_CURRENT_TIME), NULL);
-			if (cir == NULL)
+			if ((cir = cirs[i]) == NULL)
 				continue;
 			if (cir->num_outputs == 0) {
 				free(cir);
 				continue;
 			}
 
+			if (k == 0)
+				sp = &specs[nspecs++];
+			else
+				sp = NULL;
+
 			if (cir->mode == 0) {
-				new_region(s, 0, 0, screen->width_in_pixels,
-				    screen->height_in_pixels, ROTATION_DEFAULT);
+				if (sp) {
+					sp->randr_id = crtc[i];
+					sp->g.w = screen->width_in_pixels;
+					sp->g.h = screen->height_in_pixels;
+					sp->g.r = ROTATION_DEFAULT;
+				}
 			} else {
-				new_region(s, cir->x, cir->y, cir->width,
-				    cir->height, cir->rotation & 0xf);
+				if (sp) {
+					sp->randr_id = crtc[i];
+					sp->g.x = cir->x;
+					sp->g.y = cir->y;
+					sp->g.w = cir->width;
+					sp->g.h = cir->height;
+					sp->g.r = cir->rotation & 0xf;
+				}
 
 				/* Determine the crtc refresh rate. */
 				for (j = 0; j < nmodes; j++) {
@@ -17850,6 +20778,7 @@ scan_randr(struct swm_screen *s)
 			}
 			free(cir);
 		}
+		free(cirs);
 		free(srr);
 
 		s->rate = (minrate > 0) ? minrate : SWM_RATE_DEFAULT;
@@ -17858,19 +20787,75 @@ scan_randr(struct swm_screen *s)
 	}
 #endif /* XCB_RANDR_GET_SCREEN_RESOURCES_CURRENT */
 
-	/* If detection failed, create a single region that spans the screen. */
-	if (TAILQ_EMPTY(&s->rl))
-		new_region(s, 0, 0, screen->width_in_pixels,
-		    screen->height_in_pixels, ROTATION_DEFAULT);
+	/* If detection failed, use a single region that spans the screen. */
+	if (nspecs == 0) {
+		sp = &specs[nspecs++];
+		sp->randr_id = XCB_NONE;
+		sp->g.w = screen->width_in_pixels;
+		sp->g.h = screen->height_in_pixels;
+		sp->g.r = ROTATION_DEFAULT;
+	}
+
+	/*
+	 * new_region() replaces any region a later spec overlaps, so drop
+	 * overlapped specs (e.g. mirrored CRTCs) up front; otherwise a kept
+	 * region would be replaced on every scan.
+	 */
+	for (i = 0; i < nspecs; i++)
+		for (k = i + 1; k < nspecs; k++)
+			if (specs[i].g.x < specs[k].g.x + specs[k].g.w &&
+			    specs[i].g.x + specs[i].g.w > specs[k].g.x &&
+			    specs[i].g.y < specs[k].g.y + specs[k].g.h &&
+			    specs[i].g.y + specs[i].g.h > specs[k].g.y) {
+				specs[i].used = true;
+				break;
+			}
+
+	/* Keep regions whose CRTC/monitor persists; retire the rest. */
+	TAILQ_FOREACH_SAFE(r, &s->rl, entry, rn) {
+		for (i = 0; i < nspecs; i++) {
+			sp = &specs[i];
+			if (sp->used || sp->randr_id != r->randr_id)
+				continue;
+			/* Regions not from RandR can only match exactly. */
+			if (sp->randr_id == XCB_NONE && memcmp(&sp->g, &r->g,
+			    sizeof sp->g))
+				continue;
+			break;
+		}
+
+		if (i < nspecs) {
+			specs[i].used = true;
+			if (memcmp(&specs[i].g, &r->g, sizeof r->g)) {
+				update_region_geometry(r, &specs[i].g);
+				changed = true;
+			}
+		} else {
+			r->ws->old_r = r->ws->r = NULL;
+			remove_region(r);
+			changed = true;
+		}
+	}
+
+	/* Create regions for new CRTCs/monitors. */
+	for (i = 0; i < nspecs; i++) {
+		sp = &specs[i];
+		if (sp->used)
+			continue;
+		r = new_region(s, sp->g.x, sp->g.y, sp->g.w, sp->g.h, sp->g.r);
+		r->randr_id = sp->randr_id;
+		changed = true;
+	}
+	free(specs);
 
-#ifdef XCB_RANDR_GET_SCREEN_RESOURCES_CURRENT
-out:
-#endif
 	/* Cleanup references to unused regions. */
-	TAILQ_FOREACH(r, &s->orl, entry)
-		kill_refs_region(r);
+	if (changed)
+		TAILQ_FOREACH(r, &s->orl, entry)
+			kill_refs_region(r);
+
+	DNPRINTF(SWM_D_MISC, "done, changed: %s\n", YESNO(changed));
 
-	DNPRINTF(SWM_D_MISC, "done.\n");
+	return (changed);
 }
 
 static void
@@ -17887,8 +20872,11 @@ screenchange(xcb_randr_screen_change_notify_event_t *e)
 	if (s == NULL)
 		errx(1, "screenchange: screen not found.");
 
-	/* brute force for now, just re-enumerate the regions */
-	scan_randr(s);
+	/* Nothing to do if the monitor layout is unchanged. */
+	if (!scan_randr(s)) {
+		DNPRINTF(SWM_D_EVENT, "regions unchanged.\n");
+		return;
+	}
 
 	if (swm_debug & SWM_D_EVENT)
 		print_win_geom(e->root);
@@ -18098,12 +21086,14 @@ setup_screens(void)
 		TAILQ_INIT(&s->rl);
 		TAILQ_INIT(&s->orl);
 		RB_INIT(&s->workspaces);
+		RB_INIT(&s->key_grabs);
 		TAILQ_INIT(&s->priority);
 		SLIST_INIT(&s->stack);
 		SLIST_INIT(&s->struts);
 		TAILQ_INIT(&s->fl);
 		TAILQ_INIT(&s->iconified);
 		TAILQ_INIT(&s->managed);
+		TAILQ_INIT(&s->search_pool);
 
 		s->r->id = XCB_WINDOW_NONE; /* Not needed for root region. */
 		X(s->r) = 0;
@@ -18125,7 +21115,12 @@ setup_screens(void)
 		s->colormap = screen->default_colormap;
 		s->xvisual = DefaultVisual(display, i);
 		s->bar_xftfonts = NULL;
+		s->bar_xftref = NULL;
 		s->managed_count = 0;
+		s->ewmh_dirty = 0;
+		if ((s->root_props = calloc(SWM_EWMH_HINT_MAX,
+		    sizeof(struct swm_root_prop))) == NULL)
+			err(1, "setup_screens: calloc");
 
 		DNPRINTF(SWM_D_INIT, "root_depth: %d, screen_depth: %d\n",
 		    screen->root_depth, xcb_aux_get_depth(conn, screen));
@@ -18226,6 +21221,10 @@ setup_extensions(void)
 #ifdef SWM_XCB_HAS_XINPUT
 	xcb_input_xi_query_version_reply_t	*xiqvr;
 #endif
+#ifdef SWM_XCB_HAS_XKB
+	xcb_xkb_use_extension_reply_t		*xuer;
+	uint16_t				xkb_events;
+#endif
 
 	randr_support = false;
 	randr_scan = false;
@@ -18248,12 +21247,18 @@ setup_extensions(void)
 				if (rqvr->minor_version >= 3 ||
 				    rqvr->major_version > 1)
 					randr_scan = true;
+#ifdef XCB_RANDR_GET_MONITORS
+				if (rqvr->minor_version >= 5 ||
+				    rqvr->major_version > 1)
+					randr_monitors = true;
+#endif
 			}
 			free(rqvr);
 		}
 	}
-	DNPRINTF(SWM_D_INIT, "randr_support: %s, randr_scan: %s\n",
-	    YESNO(randr_support), YESNO(randr_scan));
+	DNPRINTF(SWM_D_INIT, "randr_support: %s, randr_scan: %s, "
+	    "randr_monitors: %s\n", YESNO(randr_support), YESNO(randr_scan),
+	    YESNO(randr_monitors));
 
 #ifdef SWM_XCB_HAS_XINPUT
 	xinput2_support = false;
@@ -18282,6 +21287,34 @@ setup_extensions(void)
 		}
 	}
 #endif /* SWM_XCB_HAS_XINPUT */
+
+#ifdef SWM_XCB_HAS_XKB
+	/* Track keyboard mapping changes through XKB when available. */
+	xkb_support = false;
+	qep = xcb_get_extension_data(conn, &xcb_xkb_id);
+	if (qep->present) {
+		xuer = xcb_xkb_use_extension_reply(conn,
+		    xcb_xkb_use_extension(conn, XCB_XKB_MAJOR_VERSION,
+		    XCB_XKB_MINOR_VERSION), NULL);
+		if (xuer) {
+			DNPRINTF(SWM_D_INIT, "X server XKB version: %u.%u, "
+			    "supported: %s, first_event: %u\n",
+			    xuer->serverMajor, xuer->serverMinor,
+			    YESNO(xuer->supported), qep->first_event);
+			if (xuer->supported) {
+				xkb_support = true;
+				xkb_eventbase = qep->first_event;
+				xkb_events = XCB_XKB_EVENT_TYPE_NEW_KEYBOARD_NOTIFY |
+				    XCB_XKB_EVENT_TYPE_MAP_NOTIFY;
+				xcb_xkb_select_events(conn,
+				    XCB_XKB_ID_USE_CORE_KBD, xkb_events, 0,
+				    xkb_events, 0xff, 0xff, NULL);
+			}
+			free(xuer);
+		}
+	}
+	DNPRINTF(SWM_D_INIT, "xkb_support: %s\n", YESNO(xkb_support));
+#endif /* SWM_XCB_HAS_XKB */
 	DNPRINTF(SWM_D_INIT, "xinput2_support: %s, xinput2_raw: %s\n",
 	    YESNO(xinput2_support), YESNO(xinput2_raw));
 }
@@ -18289,6 +21322,8 @@ setup_extensions(void)
 static void
 load_defaults(void)
 {
+	struct bar_source	*bs;
+
 	boundary_width = 50;
 	snap_range = 25;
 	cycle_empty = false;
@@ -18301,6 +21336,7 @@ load_defaults(void)
 	warp_pointer = false;
 	workspace_autorotate = false;
 	workspace_clamp = false;
+	workspace_park = false;
 	bar_version = false;
 	bar_enabled = true;
 	bar_border_width = 1;
@@ -18311,6 +21347,11 @@ load_defaults(void)
 	bar_padding_vertical = 0;
 	bar_justify = SWM_BAR_JUSTIFY_LEFT;
 	bar_action_expand = false;
+	bar_action_keyed = false;
+	TAILQ_FOREACH(bs, &bar_sources, entry) {
+		bs->configured = false;
+		bs->interval = 0;
+	}
 	bar_workspace_limit = 0;
 	stack_enabled = true;
 	clock_enabled = true;
@@ -18450,20 +21491,64 @@ load_defaults(void)
 static void
 setup_globals(void)
 {
+	static const struct {
+		const char	*name;
+		xcb_atom_t	*atom;
+	} core[] = {
+		{ "WM_STATE",			&a_state },
+		{ "WM_CHANGE_STATE",		&a_change_state },
+		{ "WM_PROTOCOLS",		&a_prot },
+		{ "WM_DELETE_WINDOW",		&a_delete },
+		{ "_NET_FRAME_EXTENTS",		&a_net_frame_extents },
+		{ "_NET_SUPPORTED",		&a_net_supported },
+		{ "_NET_SUPPORTING_WM_CHECK",	&a_net_wm_check },
+		{ "_NET_WM_PID",		&a_net_wm_pid },
+		{ "WM_TAKE_FOCUS",		&a_takefocus },
+		{ "UTF8_STRING",		&a_utf8_string },
+		{ "_SWM_PID",			&a_swm_pid },
+		{ "_SWM_WS",			&a_swm_ws },
+	};
+	const char		*names[LENGTH(core) + LENGTH(ewmh)];
+	xcb_atom_t		*atoms[LENGTH(core) + LENGTH(ewmh)];
+	int			i, n = 0;
+
 	load_defaults();
 
-	a_state = get_atom_from_string("WM_STATE");
-	a_change_state = get_atom_from_string("WM_CHANGE_STATE");
-	a_prot = get_atom_from_string("WM_PROTOCOLS");
-	a_delete = get_atom_from_string("WM_DELETE_WINDOW");
-	a_net_frame_extents = get_atom_from_string("_NET_FRAME_EXTENTS");
-	a_net_supported = get_atom_from_string("_NET_SUPPORTED");
-	a_net_wm_check = get_atom_from_string("_NET_SUPPORTING_WM_CHECK");
-	a_net_wm_pid = get_atom_from_string("_NET_WM_PID");
-	a_takefocus = get_atom_from_string("WM_TAKE_FOCUS");
-	a_utf8_string = get_atom_from_string("UTF8_STRING");
-	a_swm_pid = get_atom_from_string("_SWM_PID");
-	a_swm_ws = get_atom_from_string("_SWM_WS");
+	for (i = 0; i < LENGTH(core); i++) {
+		names[n] = core[i].name;
+		atoms[n++] = core[i].atom;
+	}
+	for (i = 0; i < LENGTH(ewmh); i++) {
+		names[n] = ewmh[i].name;
+		atoms[n++] = &ewmh[i].atom;
+	}
+
+	/* One batch instead of a round trip per atom. */
+	get_atoms_from_strings(names, atoms, n);
+}
+
+/* Report time spent in each startup phase (debug only). */
+static void
+startup_phase(const char *phase)
+{
+	static struct timespec	start, last;
+	struct timespec		now;
+
+	if (!(swm_debug & SWM_D_INIT))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (phase == NULL) {
+		start = last = now;
+		return;
+	}
+
+	DNPRINTF(SWM_D_INIT, "%s: %.3f ms (total: %.3f ms)\n", phase,
+	    (now.tv_sec - last.tv_sec) * 1e3 +
+	    (now.tv_nsec - last.tv_nsec) / 1e6,
+	    (now.tv_sec - start.tv_sec) * 1e3 +
+	    (now.tv_nsec - start.tv_nsec) / 1e6);
+	last = now;
 }
 
 static char *
@@ -18570,7 +21655,7 @@ shutdown_cleanup(void)
 	struct swm_region	*r;
 	struct ws_win		*w;
 	struct workspace	*ws;
-	int			i, num_screens;
+	int			i, j, num_screens;
 
 	/* disable alarm because the following code may not be interrupted */
 	alarm(0);
@@ -18578,6 +21663,14 @@ shutdown_cleanup(void)
 		err(1, "can't disable alarm");
 
 	bar_extra_stop();
+	bar_sources_clear();
+	bar_stat_close();
+
+	conf_watch_clear();
+	if (conf_notify_fd != -1) {
+		close(conf_notify_fd);
+		conf_notify_fd = -1;
+	}
 
 	cursors_cleanup();
 
@@ -18599,9 +21692,17 @@ shutdown_cleanup(void)
 		if (s->gc != XCB_NONE)
 			xcb_free_gc(conn, s->gc);
 
+		/* Client list order is used to restore tiling on restart. */
+		ewmh_flush(s);
+		for (j = 0; j < SWM_EWMH_HINT_MAX; j++)
+			ewmh_root_prop_clear(s, j);
+		free(s->root_props);
+
 		clear_colors(s);
 		xft_free(s);
 		clear_stack(s);
+		clear_key_grabs(s);
+		search_win_pool_free(s);
 
 #ifndef __clang_analyzer__ /* Suppress false warnings. */
 		/* Cleanup window state and memory. */
@@ -18637,6 +21738,7 @@ shutdown_cleanup(void)
 		while ((r = TAILQ_FIRST(&s->rl)) != NULL) {
 			TAILQ_REMOVE(&s->rl, r, entry);
 			if (r->bar) {
+				free(r->bar->last_text);
 				free(r->bar->st);
 				free(r->bar);
 			}
@@ -18644,6 +21746,8 @@ shutdown_cleanup(void)
 			free(r);
 		}
 
+		region_index_free(s);
+
 		while ((r = TAILQ_FIRST(&s->orl)) != NULL) {
 			TAILQ_REMOVE(&s->orl, r, entry);
 			free(r);
@@ -18652,6 +21756,7 @@ shutdown_cleanup(void)
 		free(s->r);
 	}
 	free(screens);
+	xft_fonts_prune();
 
 	if (bar_fontnames) {
 		for (i = 0; i < num_xftfonts; i++)
@@ -18721,6 +21826,17 @@ event_handle(xcb_generic_event_t *evt)
 	DNPRINTF(SWM_D_EVENT, "%s(%d), seq %u, sent: %s\n", get_event_label(evt),
 	    type, evt->sequence, YESNO(XCB_EVENT_SENT(evt)));
 
+	/* Other clients can change which window is under the pointer. */
+	switch (type) {
+	case XCB_MAP_NOTIFY:
+	case XCB_UNMAP_NOTIFY:
+	case XCB_CONFIGURE_NOTIFY:
+	case XCB_DESTROY_NOTIFY:
+	case XCB_REPARENT_NOTIFY:
+		pointer_cache.valid = false;
+		break;
+	}
+
 	if (type <= XCB_MAPPING_NOTIFY) {
 		switch (type) {
 #define EVENT(type, callback) case type: callback((void *)evt); return
@@ -18772,6 +21888,10 @@ event_handle(xcb_generic_event_t *evt)
 	} else if (randr_support &&
 	    (type - randr_eventbase) == XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
 		screenchange((void *)evt);
+#ifdef SWM_XCB_HAS_XKB
+	} else if (xkb_support && type == xkb_eventbase) {
+		xkbevent(evt);
+#endif
 	}
 }
 
@@ -18789,13 +21909,15 @@ usage(void)
 int
 main(int argc, char *argv[])
 {
-	struct pollfd		pfd[2];
+	struct pollfd		*pfd;
 	struct sigaction	sact;
 	struct swm_region	*r;
 	xcb_generic_event_t	*evt;
 	xcb_mapping_notify_event_t *mne;
-	int			ch, i, num_screens, num_readable;
-	bool			stdin_ready = false;
+	int			ch, i, num_screens, num_readable, npfd, nsrc;
+	int			timeout;
+	bool			bar_ready = false, src_changed;
+	char			sigbuf[16];
 
 	while ((ch = getopt(argc, argv, "c:dhv")) != -1) {
 		switch (ch) {
@@ -18824,6 +21946,14 @@ main(int argc, char *argv[])
 	if (setlocale(LC_CTYPE, "") == NULL || setlocale(LC_TIME, "") == NULL)
 		warnx("no locale support");
 
+	if (pipe(sig_pipe) == -1)
+		err(1, "pipe error");
+	for (i = 0; i < 2; i++) {
+		socket_setnonblock(sig_pipe[i]);
+		if (fcntl(sig_pipe[i], F_SETFD, FD_CLOEXEC) == -1)
+			err(1, "fcntl F_SETFD");
+	}
+
 	/* handle some signals */
 	bzero(&sact, sizeof(sact));
 	sigemptyset(&sact.sa_mask);
@@ -18877,11 +22007,16 @@ main(int argc, char *argv[])
 	cursors_load();
 
 	xcb_aux_sync(conn);
+	startup_phase(NULL);
 
 	setup_globals();
+	startup_phase("globals");
 	setup_extensions();
+	startup_phase("extensions");
 	setup_screens();
+	startup_phase("screens");
 	setup_ewmh();
+	startup_phase("ewmh");
 	setup_keybindings();
 	setup_btnbindings();
 	setup_quirks();
@@ -18891,10 +22026,12 @@ main(int argc, char *argv[])
 		conf_file = scan_config();
 	if (conf_file)
 		conf_load(conf_file, SWM_CONF_DEFAULT);
+	startup_phase("config");
 
 	setup_marks();
 	setup_fonts();
 	validate_spawns();
+	startup_phase("fonts");
 
 	if (getenv("SWM_STARTED") == NULL)
 		setenv("SWM_STARTED", "YES", 1);
@@ -18915,9 +22052,11 @@ main(int argc, char *argv[])
 
 	/* Manage existing windows. */
 	grab_windows();
+	startup_phase("grab windows");
 
 	grabkeys();
 	grabbuttons();
+	startup_phase("grabs");
 
 	/* Stack all regions to trigger mapping. */
 	for (i = 0; i < num_screens; i++) {
@@ -18932,12 +22071,19 @@ main(int argc, char *argv[])
 	flush();
 
 	setup_focus();
+	startup_phase("layout");
 
-	memset(&pfd, 0, sizeof(pfd));
+	npfd = SWM_POLL_FIXED;
+	if ((pfd = calloc(npfd, sizeof *pfd)) == NULL)
+		err(1, "main: calloc");
 	pfd[0].fd = xcb_get_file_descriptor(conn);
 	pfd[0].events = POLLIN;
-	pfd[1].fd = STDIN_FILENO;
+	pfd[1].fd = -1;
 	pfd[1].events = POLLIN;
+	pfd[2].events = POLLIN;
+	pfd[3].events = 0;	/* POLLHUP is always reported. */
+	pfd[4].fd = sig_pipe[0];
+	pfd[4].events = POLLIN;
 
 	while (running) {
 		while ((evt = get_next_event(false))) {
@@ -18952,21 +22098,57 @@ main(int argc, char *argv[])
 			continue;
 		}
 
-		num_readable = poll(pfd, bar_extra ? 2 : 1, 1000);
+		keymap_refresh();
+		bar_flush();
+
+		/* Publish pending root properties before blocking. */
+		for (i = 0; i < num_screens; i++)
+			ewmh_flush(&screens[i]);
+		xcb_flush(conn);
+
+		timeout = bar_sources_schedule(conf_watch_timeout(1000));
+		if (npfd < SWM_POLL_FIXED + bar_source_count) {
+			npfd = SWM_POLL_FIXED + bar_source_count;
+			if ((pfd = reallocarray(pfd, npfd, sizeof *pfd)) == NULL)
+				err(1, "main: reallocarray");
+		}
+
+		/* Negative fds are ignored by poll(). */
+		pfd[1].fd = bar_extra ? bar_fd : -1;
+		pfd[2].fd = conf_notify_fd;
+		pfd[3].fd = searchpid ? select_resp_pipe[0] : -1;
+		nsrc = bar_sources_pollfd(pfd + SWM_POLL_FIXED);
+
+		src_changed = false;
+		num_readable = poll(pfd, SWM_POLL_FIXED + nsrc, timeout);
 		if (num_readable > 0) {
 			if (pfd[0].revents & POLLHUP)
 				goto done;
 
-			if (bar_extra) {
-				if (pfd[1].revents & POLLHUP)
-					bar_extra = false;
-				else if (pfd[1].revents & POLLIN)
-					stdin_ready = true;
-			}
+			/* Drain to EOF on hangup to keep the last output. */
+			if (bar_extra && pfd[1].revents & (POLLIN | POLLHUP))
+				bar_ready = true;
+
+			if (pfd[2].revents & POLLIN)
+				conf_watch_read();
+
+			/* Act on the menu response once the menu closes it. */
+			if (pfd[3].revents & (POLLHUP | POLLERR))
+				search_resp = 1;
+
+			if (pfd[4].revents & POLLIN)
+				while (read(sig_pipe[0], sigbuf, sizeof sigbuf) > 0)
+					;
+
+			src_changed = bar_sources_read(pfd + SWM_POLL_FIXED,
+			    nsrc);
 		} else if (num_readable == -1) {
 			DNPRINTF(SWM_D_MISC, "poll: %s\n", strerror(errno));
 		}
 
+		if (conf_watch_settled())
+			reload_conf = 1;
+
 		if (restart_wm)
 			restart(NULL, NULL, NULL);
 		if (reload_conf) {
@@ -18977,12 +22159,17 @@ main(int argc, char *argv[])
 		if (!running)
 			goto done;
 
-		if (stdin_ready) {
-			stdin_ready = false;
-			if (bar_extra_update() == 0)
+		if (bar_ready) {
+			bar_ready = false;
+			if (bar_extra_update() == 0 && !src_changed)
 				continue;
 		}
 
+		/* Raw XI2 input alone leaves the bars as they are. */
+		if (num_readable == 1 && pfd[0].revents & POLLIN &&
+		    pending_raw_input_only())
+			continue;
+
 		/* Need to ensure the bar(s) are always updated. */
 		for (i = 0; i < num_screens; i++)
 			update_bars(&screens[i]);
@@ -18991,6 +22178,7 @@ main(int argc, char *argv[])
 	}
 done:
 	shutdown_cleanup();
+	free(pfd);
 
 	return (0);
 }